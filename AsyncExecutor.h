@@ -0,0 +1,652 @@
+#ifndef ASYNC_EXECUTOR_H
+#define ASYNC_EXECUTOR_H
+
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef IPM_HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include "Logger.h"
+#include "WorkStealingPool.h"
+using namespace std;
+
+// C++20 coroutines for the I/O side of a stream: sources and sinks are coroutines that
+// suspend while their pipe / socket isn't ready instead of blocking a thread, CPU work is
+// offloaded to a WorkStealingPool. All coroutines of an IoLoop are resumed on the thread
+// that calls run(), so the state they share (channels, counters) needs no locks.
+
+template<typename T = void>
+class Task;
+
+struct TaskPromiseBase {
+    coroutine_handle<> continuation;    // the coroutine co_awaiting this one
+    exception_ptr error;
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> done) noexcept {
+            coroutine_handle<> next = done.promise().continuation;
+            return next ? next : noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception(){ error = current_exception(); }
+};
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+    optional<T> value;
+    Task<T> get_return_object();
+    template<typename U>
+    void return_value(U&& v){ value.emplace(forward<U>(v)); }
+    T take(){
+        if (error){
+            rethrow_exception(error);
+        }
+        return move(*value);
+    }
+};
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void(){}
+    void take(){
+        if (error){
+            rethrow_exception(error);
+        }
+    }
+};
+
+// Lazy coroutine: starts when co_awaited and resumes the awaiting coroutine when done
+// (symmetric transfer, no stack growth across long await chains). Exceptions propagate to
+// the awaiting coroutine.
+template<typename T>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+private:
+    coroutine_handle<promise_type> handle;
+public:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle){}
+    Task(Task&& other) noexcept : handle(exchange(other.handle, nullptr)){}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other){
+            if (handle){
+                handle.destroy();
+            }
+            handle = exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task(){
+        if (handle){
+            handle.destroy();
+        }
+    }
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume(){ return handle.promise().take(); }
+};
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object(){
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object(){
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Single-threaded reactor: epoll for pipes, sockets and FIFOs, io_uring (IPM_HAVE_LIBURING)
+// or the pool for regular files, which epoll can't wait on.
+class IoLoop {
+private:
+    struct FdWaiters {
+        coroutine_handle<> reader;
+        coroutine_handle<> writer;
+        bool added = false;
+    };
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object(){ return Detached{coroutine_handle<promise_type>::from_promise(*this)}; }
+            suspend_always initial_suspend() noexcept { return {}; }
+            suspend_never final_suspend() noexcept { return {}; }
+            void return_void(){}
+            void unhandled_exception(){}
+        };
+        coroutine_handle<promise_type> handle;
+    };
+    WorkStealingPool& pool;
+    int epoll_fd;
+    int wake_fd;                        // eventfd, signalled by post()
+    map<int, FdWaiters> fds;
+    deque<coroutine_handle<>> ready;    // loop thread only
+    mutex posted_mtx;
+    vector<coroutine_handle<>> posted;  // from other threads
+    int live;                           // spawned tasks not finished
+#ifdef IPM_HAVE_LIBURING
+    io_uring ring;
+    bool ring_ok;
+    int ring_fd;                        // eventfd registered with the ring
+#endif
+
+    static Detached runDetached(IoLoop* loop, Task<void> task){
+        try {
+            co_await task;
+        } catch(const exception& e){
+            LOG_ERROR("Async task failed: " + string(e.what()));
+        }
+        loop->live--;
+    }
+    void watch(int fd){
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    // (re)arm the one-shot registration of fd for its current waiters
+    void arm(int fd){
+        FdWaiters& w = fds[fd];
+        epoll_event ev{};
+        ev.events = EPOLLONESHOT;
+        if (w.reader){
+            ev.events |= EPOLLIN;
+        }
+        if (w.writer){
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, w.added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) == 0){
+            w.added = true;
+            return;
+        }
+        // not pollable: let the waiters retry (their I/O then simply blocks)
+        LOG_WARNING("epoll cannot wait on fd " + to_string(fd) + ": " + strerror(errno));
+        wakeFd(fd, EPOLLIN | EPOLLOUT);
+    }
+    void wakeFd(int fd, uint32_t events){
+        FdWaiters& w = fds[fd];
+        if (w.reader && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))){
+            ready.push_back(exchange(w.reader, nullptr));
+        }
+        if (w.writer && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))){
+            ready.push_back(exchange(w.writer, nullptr));
+        }
+    }
+#ifdef IPM_HAVE_LIBURING
+    void reapRing(){
+        io_uring_cqe* cqe = nullptr;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0 && cqe){
+            auto* read = static_cast<FileRead*>(io_uring_cqe_get_data(cqe));
+            read->result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            ready.push_back(read->waiting);
+        }
+    }
+#endif
+public:
+    explicit IoLoop(WorkStealingPool& pool) : pool(pool), live(0){
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        watch(wake_fd);
+#ifdef IPM_HAVE_LIBURING
+        ring_ok = io_uring_queue_init(64, &ring, 0) == 0;
+        ring_fd = -1;
+        if (ring_ok){
+            ring_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (io_uring_register_eventfd(&ring, ring_fd) == 0){
+                watch(ring_fd);
+            } else {
+                io_uring_queue_exit(&ring);
+                close(ring_fd);
+                ring_fd = -1;
+                ring_ok = false;
+            }
+        }
+#endif
+    }
+    ~IoLoop(){
+#ifdef IPM_HAVE_LIBURING
+        if (ring_ok){
+            io_uring_queue_exit(&ring);
+            close(ring_fd);
+        }
+#endif
+        close(wake_fd);
+        close(epoll_fd);
+    }
+    IoLoop(const IoLoop&) = delete;
+    IoLoop& operator=(const IoLoop&) = delete;
+
+    WorkStealingPool& workers(){ return pool; }
+
+    // start a task on the next turn of the loop (loop thread, or before run())
+    void spawn(Task<void> task){
+        live++;
+        ready.push_back(runDetached(this, move(task)).handle);
+    }
+    // resume h on the loop thread (any thread)
+    void post(coroutine_handle<> h){
+        {
+            lock_guard<mutex> lock(posted_mtx);
+            posted.push_back(h);
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    // resume h on the next turn (loop thread)
+    void resumeLater(coroutine_handle<> h){ ready.push_back(h); }
+    // drop fd from epoll before it is closed
+    void forget(int fd){
+        auto it = fds.find(fd);
+        if (it != fds.end()){
+            if (it->second.added){
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            fds.erase(it);
+        }
+    }
+
+    // Run until every spawned task has finished
+    void run(){
+        epoll_event events[64];
+        while (live > 0){
+            while (!ready.empty()){
+                coroutine_handle<> h = ready.front();
+                ready.pop_front();
+                h.resume();
+            }
+            if (live == 0){
+                break;
+            }
+            int n = epoll_wait(epoll_fd, events, 64, -1);
+            if (n < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                LOG_ERROR("epoll_wait failed: " + string(strerror(errno)));
+                return;
+            }
+            for (int i = 0; i < n; i++){
+                int fd = events[i].data.fd;
+                if (fd == wake_fd){
+                    uint64_t count;
+                    ssize_t ignored = read(wake_fd, &count, sizeof(count));
+                    (void)ignored;
+                    lock_guard<mutex> lock(posted_mtx);
+                    ready.insert(ready.end(), posted.begin(), posted.end());
+                    posted.clear();
+                    continue;
+                }
+#ifdef IPM_HAVE_LIBURING
+                if (fd == ring_fd){
+                    uint64_t count;
+                    ssize_t ignored = read(ring_fd, &count, sizeof(count));
+                    (void)ignored;
+                    reapRing();
+                    continue;
+                }
+#endif
+                wakeFd(fd, events[i].events);
+                FdWaiters& w = fds[fd];
+                if (w.reader || w.writer){
+                    arm(fd);
+                }
+            }
+        }
+    }
+
+    // co_await loop.readable(fd) / writable(fd): suspend until fd is ready
+    struct IoWait {
+        IoLoop& loop;
+        int fd;
+        bool write;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h){
+            FdWaiters& w = loop.fds[fd];
+            (write ? w.writer : w.reader) = h;
+            loop.arm(fd);
+        }
+        void await_resume() const noexcept {}
+    };
+    IoWait readable(int fd){ return IoWait{*this, fd, false}; }
+    IoWait writable(int fd){ return IoWait{*this, fd, true}; }
+
+    // co_await loop.readFile(...): pread on io_uring when available, else on the pool.
+    // Returns the byte count or -errno.
+    struct FileRead {
+        IoLoop& loop;
+        int fd;
+        void* buf;
+        size_t size;
+        uint64_t offset;
+        coroutine_handle<> waiting;
+        ssize_t result = 0;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h){
+            waiting = h;
+#ifdef IPM_HAVE_LIBURING
+            if (loop.ring_ok){
+                io_uring_sqe* sqe = io_uring_get_sqe(&loop.ring);
+                if (sqe){
+                    io_uring_prep_read(sqe, fd, buf, static_cast<unsigned>(size), offset);
+                    io_uring_sqe_set_data(sqe, this);
+                    io_uring_submit(&loop.ring);
+                    return;
+                }
+            }
+#endif
+            loop.pool.submit([this]{
+                result = pread(fd, buf, size, static_cast<off_t>(offset));
+                if (result < 0){
+                    result = -errno;
+                }
+                loop.post(waiting);
+            });
+        }
+        ssize_t await_resume() const noexcept { return result; }
+    };
+    FileRead readFile(int fd, void* buf, size_t size, uint64_t offset){
+        return FileRead{*this, fd, buf, size, offset, nullptr};
+    }
+
+    // co_await loop.offload(fn): run fn() on the pool, resume here with its result
+    template<typename F>
+    struct Offload {
+        using Result = invoke_result_t<F&>;
+        IoLoop& loop;
+        F fn;
+        conditional_t<is_void_v<Result>, bool, optional<Result>> result{};
+        exception_ptr error;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h){
+            loop.pool.submit([this, h]{
+                try {
+                    if constexpr (is_void_v<Result>){
+                        fn();
+                    } else {
+                        result.emplace(fn());
+                    }
+                } catch(...){
+                    error = current_exception();
+                }
+                loop.post(h);
+            });
+        }
+        Result await_resume(){
+            if (error){
+                rethrow_exception(error);
+            }
+            if constexpr (!is_void_v<Result>){
+                return move(*result);
+            }
+        }
+    };
+    template<typename F>
+    Offload<F> offload(F fn){ return Offload<F>{*this, move(fn), {}, nullptr}; }
+};
+
+// Bounded queue between coroutines of one loop: push() suspends while full, pop() while
+// empty. After close() pushes fail and pops drain what is left, then return nullopt.
+template<typename T>
+class AsyncChannel {
+private:
+    IoLoop& loop;
+    size_t capacity;
+    deque<T> items;
+    deque<coroutine_handle<>> pushers;
+    deque<coroutine_handle<>> poppers;
+    bool closed;
+
+    struct Park {
+        deque<coroutine_handle<>>& waiters;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h){ waiters.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+    void wakeOne(deque<coroutine_handle<>>& waiters){
+        if (!waiters.empty()){
+            loop.resumeLater(waiters.front());
+            waiters.pop_front();
+        }
+    }
+public:
+    AsyncChannel(IoLoop& loop, size_t capacity) : loop(loop), capacity(max(size_t(1), capacity)), closed(false){}
+
+    Task<bool> push(T value){
+        while (!closed && items.size() >= capacity){
+            co_await Park{pushers};
+        }
+        if (closed){
+            co_return false;
+        }
+        items.push_back(move(value));
+        wakeOne(poppers);
+        co_return true;
+    }
+    Task<optional<T>> pop(){
+        while (!closed && items.empty()){
+            co_await Park{poppers};
+        }
+        if (items.empty()){
+            co_return nullopt;
+        }
+        T value = move(items.front());
+        items.pop_front();
+        wakeOne(pushers);
+        co_return value;
+    }
+    void close(){
+        closed = true;
+        while (!pushers.empty()){
+            wakeOne(pushers);
+        }
+        while (!poppers.empty()){
+            wakeOne(poppers);
+        }
+    }
+    size_t size() const { return items.size(); }
+};
+
+// One end of a byte stream: "-" (stdin / stdout), "tcp:host:port", "unix:path", or a path
+// (file, FIFO, character device). Pipes and sockets are switched to non-blocking and waited
+// on with epoll, regular files are read through IoLoop::readFile(). Anything else on
+// stdin / stdout (a terminal, /dev/null) is read and written with blocking calls on the pool:
+// O_NONBLOCK there would change the file description the shell and stderr share.
+class AsyncStream {
+private:
+    IoLoop& loop;
+    string spec;
+    int fd;
+    bool owned;
+    bool pollable;
+    bool seekable;          // regular file or block device: positioned reads
+    int saved_flags;
+    uint64_t offset;        // regular files
+
+    static int connectTo(const string& spec){
+        if (spec.rfind("unix:", 0) == 0){
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, spec.c_str() + 5, sizeof(addr.sun_path) - 1);
+            int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (s >= 0 && connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+                ::close(s);
+                s = -1;
+            }
+            return s;
+        }
+        // tcp:host:port
+        size_t colon = spec.rfind(':');
+        string host = spec.substr(4, colon - 4), port = spec.substr(colon + 1);
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (colon <= 4 || getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0){
+            return -1;
+        }
+        int s = -1;
+        for (addrinfo* a = found; a && s < 0; a = a->ai_next){
+            s = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            if (s >= 0 && connect(s, a->ai_addr, a->ai_addrlen) != 0){
+                ::close(s);
+                s = -1;
+            }
+        }
+        freeaddrinfo(found);
+        return s;
+    }
+public:
+    explicit AsyncStream(IoLoop& loop) : loop(loop), fd(-1), owned(false), pollable(false), seekable(false), saved_flags(-1), offset(0){}
+    ~AsyncStream(){ close(); }
+    AsyncStream(const AsyncStream&) = delete;
+    AsyncStream& operator=(const AsyncStream&) = delete;
+
+    bool open(const string& endpoint, bool for_write){
+        spec = endpoint;
+        if (spec == "-"){
+            fd = for_write ? STDOUT_FILENO : STDIN_FILENO;
+            owned = false;
+        } else if (spec.rfind("tcp:", 0) == 0 || spec.rfind("unix:", 0) == 0){
+            fd = connectTo(spec);
+            owned = true;
+        } else {
+            // opening a FIFO waits for the other end
+            fd = ::open(spec.c_str(), for_write ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+            owned = true;
+        }
+        if (fd < 0){
+            LOG_ERROR("Cannot open stream " + spec + ": " + strerror(errno));
+            return false;
+        }
+        struct stat st;
+        bool known = fstat(fd, &st) == 0;
+        seekable = known && (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode));
+        if (owned){
+            pollable = known && !seekable;
+        } else {
+            pollable = known && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+        }
+        if (pollable){
+            saved_flags = fcntl(fd, F_GETFL);
+            fcntl(fd, F_SETFL, saved_flags | O_NONBLOCK);
+        }
+        return true;
+    }
+    void close(){
+        if (fd < 0){
+            return;
+        }
+        if (pollable){
+            loop.forget(fd);
+            // stdin / stdout are shared with the parent shell
+            fcntl(fd, F_SETFL, saved_flags);
+        }
+        if (owned){
+            ::close(fd);
+        }
+        fd = -1;
+    }
+    const string& describe() const { return spec; }
+
+    // Fill buf; false at the end of the stream or on an error (logged)
+    Task<bool> readExact(void* buf, size_t size){
+        auto* p = static_cast<unsigned char*>(buf);
+        size_t got = 0;
+        while (got < size){
+            ssize_t r;
+            if (pollable){
+                r = read(fd, p + got, size - got);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                    co_await loop.readable(fd);
+                    continue;
+                }
+                if (r < 0){
+                    r = -errno;
+                }
+            } else if (seekable){
+                r = co_await loop.readFile(fd, p + got, size - got, offset);
+                if (r > 0){
+                    offset += r;
+                }
+            } else {
+                r = co_await loop.offload([&]() -> ssize_t {
+                    ssize_t n = read(fd, p + got, size - got);
+                    return n < 0 ? -errno : n;
+                });
+            }
+            if (r == -EINTR){
+                continue;
+            }
+            if (r <= 0){
+                if (r < 0){
+                    LOG_ERROR("Read from " + spec + " failed: " + strerror(static_cast<int>(-r)));
+                } else if (got > 0){
+                    LOG_WARNING(spec + " ended inside a frame (" + to_string(got) + " of " + to_string(size) + " bytes)");
+                }
+                co_return false;
+            }
+            got += r;
+        }
+        co_return true;
+    }
+    Task<bool> writeAll(const void* buf, size_t size){
+        auto* p = static_cast<const unsigned char*>(buf);
+        size_t done = 0;
+        while (done < size){
+            ssize_t r;
+            if (pollable){
+                r = write(fd, p + done, size - done);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                    co_await loop.writable(fd);
+                    continue;
+                }
+                if (r < 0){
+                    r = -errno;
+                }
+            } else {
+                // errno is per thread, hand it back in the result
+                r = co_await loop.offload([&]() -> ssize_t {
+                    ssize_t n = write(fd, p + done, size - done);
+                    return n < 0 ? -errno : n;
+                });
+            }
+            if (r == -EINTR){
+                continue;
+            }
+            if (r <= 0){
+                LOG_ERROR("Write to " + spec + " failed: " + (r < 0 ? strerror(static_cast<int>(-r)) : "nothing written"));
+                co_return false;
+            }
+            done += r;
+        }
+        co_return true;
+    }
+};
+
+#endif // ASYNC_EXECUTOR_H
@@ -0,0 +1,279 @@
+#ifndef ASYNC_FILE_READER_H
+#define ASYNC_FILE_READER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef IPM_HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include "Logger.h"
+using namespace std;
+
+// Reads upcoming files of a sorted list ahead of the consumer, so the disk (or network
+// filesystem) is busy while the CPU decodes and warps. Files are handed out in list order
+// as raw bytes for imdecode. At most max_files reads and max_bytes of file data are in
+// flight or waiting to be consumed, the file at the head of the list is always allowed
+// through so a single large file can't stall the reader.
+//
+// With liburing (IPM_HAVE_LIBURING, see CMakeLists.txt) the reads are batched through one
+// io_uring owned by the consumer thread; open/fstat stay synchronous. Otherwise a small
+// pool of reader threads does plain open/fstat/read/close.
+class AsyncFileReader {
+private:
+    struct Slot {
+        vector<unsigned char> bytes;
+        bool done = false;
+        bool ok = false;
+        int fd = -1;
+        size_t size = 0;
+        size_t offset = 0;
+    };
+    vector<string> paths;
+    size_t max_bytes;
+    size_t max_files;
+    deque<Slot> slots;          // slots[i] holds paths[base + i]
+    size_t base;                // index of the next file to hand out
+    size_t issued;              // files whose read has been started
+    size_t bytes_in_flight;
+
+    mutex mtx;
+    condition_variable slot_ready;
+    condition_variable budget_freed;
+    vector<thread> workers;
+    bool stopping;
+#ifdef IPM_HAVE_LIBURING
+    io_uring ring;
+    bool ring_ok;
+    size_t ring_pending;
+#endif
+
+    static bool fileSize(int fd, size_t& size){
+        struct stat st;
+        if (fstat(fd, &st) != 0){
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+    // may file `index` start reading? (called with mtx held)
+    bool admit(size_t index, size_t size) const {
+        return index == base || (index < base + max_files && bytes_in_flight + size <= max_bytes);
+    }
+
+    // thread pool backend: each worker claims the next file in order
+    void workerLoop(){
+        unique_lock<mutex> lock(mtx);
+        while (true){
+            budget_freed.wait(lock, [&]{ return stopping || (issued < paths.size() && issued < base + max_files); });
+            if (stopping){
+                return;
+            }
+            size_t index = issued++;
+            string path = paths[index];
+            lock.unlock();
+
+            vector<unsigned char> bytes;
+            bool ok = false;
+            size_t size = 0;
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0 && fileSize(fd, size)){
+                {
+                    unique_lock<mutex> budget_lock(mtx);
+                    budget_freed.wait(budget_lock, [&]{ return stopping || admit(index, size); });
+                    if (stopping){
+                        close(fd);
+                        return;
+                    }
+                    bytes_in_flight += size;
+                }
+                bytes.resize(size);
+                size_t done = 0;
+                while (done < size){
+                    ssize_t n = read(fd, bytes.data() + done, size - done);
+                    if (n <= 0){
+                        break;
+                    }
+                    done += n;
+                }
+                ok = (done == size && size > 0);
+            }
+            if (fd >= 0){
+                close(fd);
+            }
+
+            lock.lock();
+            if (!ok && size > 0){
+                bytes_in_flight -= size;
+                size = 0;
+                bytes.clear();
+            }
+            Slot& slot = slots[index - base];
+            slot.bytes.swap(bytes);
+            slot.size = size;
+            slot.ok = ok;
+            slot.done = true;
+            slot_ready.notify_all();
+        }
+    }
+
+#ifdef IPM_HAVE_LIBURING
+    // uring backend: open + size files ahead and queue their reads (consumer thread only)
+    void submitReads(){
+        bool queued = false;
+        while (issued < paths.size() && issued < base + max_files){
+            Slot& slot = slots[issued - base];
+            if (slot.fd < 0){
+                slot.fd = open(paths[issued].c_str(), O_RDONLY | O_CLOEXEC);
+                if (slot.fd < 0 || !fileSize(slot.fd, slot.size) || slot.size == 0){
+                    if (slot.fd >= 0) close(slot.fd);
+                    slot.fd = -1;
+                    slot.size = 0;
+                    slot.done = true;
+                    issued++;
+                    continue;
+                }
+            }
+            if (!admit(issued, slot.size)){
+                break;
+            }
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            if (!sqe){
+                break;
+            }
+            slot.bytes.resize(slot.size);
+            bytes_in_flight += slot.size;
+            io_uring_prep_read(sqe, slot.fd, slot.bytes.data(), slot.size, 0);
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(issued)));
+            ring_pending++;
+            issued++;
+            queued = true;
+        }
+        if (queued){
+            io_uring_submit(&ring);
+        }
+    }
+    // reap one completion, short reads are resubmitted for the remainder
+    void reapCompletion(){
+        io_uring_cqe* cqe = nullptr;
+        if (io_uring_wait_cqe(&ring, &cqe) < 0 || !cqe){
+            return;
+        }
+        size_t index = static_cast<size_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        ring_pending--;
+
+        Slot& slot = slots[index - base];
+        if (res > 0 && slot.offset + res < slot.size){
+            slot.offset += res;
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            if (sqe){
+                io_uring_prep_read(sqe, slot.fd, slot.bytes.data() + slot.offset, slot.size - slot.offset, slot.offset);
+                io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(index)));
+                ring_pending++;
+                io_uring_submit(&ring);
+                return;
+            }
+        }
+        slot.ok = (res > 0 && slot.offset + res == slot.size);
+        slot.done = true;
+        close(slot.fd);
+        slot.fd = -1;
+        if (!slot.ok){
+            bytes_in_flight -= slot.size;
+            slot.size = 0;
+            slot.bytes.clear();
+        }
+    }
+#endif
+
+public:
+    AsyncFileReader(const vector<string>& files, size_t max_bytes = 64u << 20, size_t max_files = 16, int threads = 4)
+        : paths(files), max_bytes(max_bytes), max_files(max(size_t(1), max_files)), base(0), issued(0),
+          bytes_in_flight(0), stopping(false){
+        slots.resize(paths.size());
+#ifdef IPM_HAVE_LIBURING
+        ring_pending = 0;
+        ring_ok = io_uring_queue_init(static_cast<unsigned>(this->max_files * 2), &ring, 0) == 0;
+        if (ring_ok){
+            LOG_INFO("Async reader: io_uring, " + to_string(this->max_files) + " files / " + to_string(max_bytes >> 20) + "MB in flight");
+            return;
+        }
+        LOG_WARNING("io_uring unavailable, falling back to reader threads");
+#endif
+        for (int i = 0; i < max(1, threads); i++){
+            workers.emplace_back(&AsyncFileReader::workerLoop, this);
+        }
+        LOG_INFO("Async reader: " + to_string(workers.size()) + " threads, " + to_string(this->max_files) + " files / " +
+                 to_string(max_bytes >> 20) + "MB in flight");
+    }
+    ~AsyncFileReader(){
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        budget_freed.notify_all();
+        for (auto& worker : workers){
+            worker.join();
+        }
+#ifdef IPM_HAVE_LIBURING
+        if (ring_ok){
+            while (ring_pending > 0){
+                reapCompletion();
+            }
+            for (auto& slot : slots){
+                if (slot.fd >= 0) close(slot.fd);
+            }
+            io_uring_queue_exit(&ring);
+        }
+#endif
+    }
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // Next file in list order. Returns false at the end of the list; a file that could not
+    // be read comes back with empty bytes.
+    bool next(string& path, vector<unsigned char>& bytes){
+        if (base >= paths.size()){
+            return false;
+        }
+        path = paths[base];
+#ifdef IPM_HAVE_LIBURING
+        if (ring_ok){
+            submitReads();
+            while (!slots.front().done){
+                reapCompletion();
+                submitReads();
+            }
+            Slot& slot = slots.front();
+            bytes.swap(slot.bytes);
+            bytes_in_flight -= slot.size;
+            slots.pop_front();
+            base++;
+            submitReads();
+            return true;
+        }
+#endif
+        unique_lock<mutex> lock(mtx);
+        slot_ready.wait(lock, [&]{ return slots.front().done; });
+        Slot& slot = slots.front();
+        bytes.swap(slot.bytes);
+        bytes_in_flight -= slot.size;
+        slots.pop_front();
+        base++;
+        lock.unlock();
+        budget_freed.notify_all();
+        return true;
+    }
+};
+
+#endif // ASYNC_FILE_READER_H
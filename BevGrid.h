@@ -0,0 +1,85 @@
+#ifndef BEV_GRID_H
+#define BEV_GRID_H
+
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include "ResultCache.h"
+#include "WaymoFrame.h"
+using namespace std;
+
+// Metric ground grid of the BEV in the vehicle frame (x forward, y left, z up, meters).
+// Forward is up in the image and left is left: row 0 is forward_max, column 0 is lateral_max.
+// Camera warps and lidar binning share one grid so their cells line up.
+struct BevGrid {
+    double forward_min = 0.0;
+    double forward_max = 40.0;
+    double lateral_min = -20.0;
+    double lateral_max = 20.0;
+    double resolution = 0.1;        // meters per pixel
+
+    int rows() const { return static_cast<int>(ceil((forward_max - forward_min) / resolution - 1e-9)); }
+    int cols() const { return static_cast<int>(ceil((lateral_max - lateral_min) / resolution - 1e-9)); }
+    // vehicle frame point -> fractional pixel (column, row) of the cell edges
+    void toPixel(double x, double y, double& col, double& row) const {
+        col = (lateral_max - y) / resolution;
+        row = (forward_max - x) / resolution;
+    }
+    // center of pixel (col, row) in the vehicle frame
+    void toVehicle(double col, double row, double& x, double& y) const {
+        x = forward_max - (row + 0.5) * resolution;
+        y = lateral_max - (col + 0.5) * resolution;
+    }
+    uint64_t hash() const {
+        double values[5] = {forward_min, forward_max, lateral_min, lateral_max, resolution};
+        return hashBytes(values, sizeof(values), 0x42455647ull);
+    }
+    string describe() const {
+        ostringstream text;
+        text << (lateral_max - lateral_min) << "m x " << (forward_max - forward_min) << "m at " << resolution * 100
+             << "cm/px (" << cols() << "x" << rows() << ")";
+        return text.str();
+    }
+};
+
+// Homography from BEV pixels (col, row, 1) to image pixels for a point on the ground plane
+// z = ground_z, row-major 3x3. Uses the pinhole part of a Waymo camera calibration: camera
+// frame is x forward, y left, z up, so u = c_u - f_u * y / x and v = c_v - f_v * z / x.
+// Intrinsics are scaled when the image was resized from the calibrated size; lens distortion
+// is not modelled. The third output coordinate is the depth along the optical axis, <= 0
+// means the ground point is behind the camera.
+inline void groundHomography(const WaymoCameraCalibration& calib, const BevGrid& grid, int image_width, int image_height,
+                             double* H, double ground_z = 0.0){
+    double sx = calib.width > 0 ? static_cast<double>(image_width) / calib.width : 1.0;
+    double sy = calib.height > 0 ? static_cast<double>(image_height) / calib.height : 1.0;
+    double fu = calib.intrinsic[0] * sx, fv = calib.intrinsic[1] * sy;
+    double cu = calib.intrinsic[2] * sx, cv = calib.intrinsic[3] * sy;
+    // projection of camera frame coordinates
+    double P[9] = {cu, -fu, 0,
+                   cv, 0, -fv,
+                   1, 0, 0};
+    // vehicle -> camera: R^T (p - t), extrinsic is camera -> vehicle
+    const double* E = calib.extrinsic;
+    double Rt[9] = {E[0], E[4], E[8],
+                    E[1], E[5], E[9],
+                    E[2], E[6], E[10]};
+    // BEV pixel -> vehicle point minus camera position
+    double res = grid.resolution;
+    double G[9] = {0, -res, grid.forward_max - 0.5 * res - E[3],
+                   -res, 0, grid.lateral_max - 0.5 * res - E[7],
+                   0, 0, ground_z - E[11]};
+    double RG[9];
+    for (int i = 0; i < 3; i++){
+        for (int j = 0; j < 3; j++){
+            RG[i * 3 + j] = Rt[i * 3] * G[j] + Rt[i * 3 + 1] * G[3 + j] + Rt[i * 3 + 2] * G[6 + j];
+        }
+    }
+    for (int i = 0; i < 3; i++){
+        for (int j = 0; j < 3; j++){
+            H[i * 3 + j] = P[i * 3] * RG[j] + P[i * 3 + 1] * RG[3 + j] + P[i * 3 + 2] * RG[6 + j];
+        }
+    }
+}
+
+#endif // BEV_GRID_H
@@ -0,0 +1,185 @@
+#ifndef BEV_MAP_H
+#define BEV_MAP_H
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include "BevGrid.h"
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+
+// Long-range ground map stitched from successive calibrated BEV frames using the vehicle pose.
+// The map is world-aligned (north-up: world +x up, world +y left) with the grid resolution and
+// is stored as a toroidal ring buffer: global map pixel (row, col) lives at
+// (row mod size, col mod size). As the vehicle moves the window recenters on it by moving
+// its origin and clearing only the strips that scroll in, nothing is shifted in memory.
+// Each frame costs one affine warp of the BEV footprint plus a masked copy into the ring.
+class BevMap {
+private:
+    BevGrid grid;           // grid of the incoming BEV frames
+    int size;               // ring side in pixels
+    Mat ring;               // CV_8UC3
+    long long top, left;    // global map pixel of the window's first row / column
+    bool placed;
+    double vehicle_x, vehicle_y, vehicle_yaw;
+    int frames;
+
+    static int wrap(long long v, int n){
+        long long m = v % n;
+        return static_cast<int>(m < 0 ? m + n : m);
+    }
+    // clear global rows [from, to) or columns of the current window
+    void clearRows(long long from, long long to){
+        for (long long r = from; r < to; r++){
+            ring.row(wrap(r, size)).setTo(Scalar(0, 0, 0));
+        }
+    }
+    void clearCols(long long from, long long to){
+        for (long long c = from; c < to; c++){
+            ring.col(wrap(c, size)).setTo(Scalar(0, 0, 0));
+        }
+    }
+    // move the window so it is centered on global pixel (row, col)
+    void scroll(long long row, long long col){
+        long long new_top = row - size / 2, new_left = col - size / 2;
+        if (!placed || llabs(new_top - top) >= size || llabs(new_left - left) >= size){
+            ring.setTo(Scalar(0, 0, 0));
+        } else {
+            if (new_top > top) clearRows(top + size, new_top + size);
+            if (new_top < top) clearRows(new_top, top);
+            if (new_left > left) clearCols(left + size, new_left + size);
+            if (new_left < left) clearCols(new_left, left);
+        }
+        top = new_top;
+        left = new_left;
+        placed = true;
+    }
+    // global map pixel -> pixel of the current vehicle's BEV frame
+    void toBev(double map_col, double map_row, double& col, double& row) const {
+        double wx = -(map_row + 0.5) * grid.resolution;
+        double wy = -(map_col + 0.5) * grid.resolution;
+        double dx = wx - vehicle_x, dy = wy - vehicle_y;
+        double c = cos(vehicle_yaw), s = sin(vehicle_yaw);
+        double vx = c * dx + s * dy;
+        double vy = -s * dx + c * dy;
+        grid.toPixel(vx, vy, col, row);
+        col -= 0.5;
+        row -= 0.5;
+    }
+    // copy a window-space tile into the ring, split where it wraps
+    void blit(const Mat& tile, const Mat& mask, long long row0, long long col0){
+        int y = 0;
+        while (y < tile.rows){
+            int ring_row = wrap(row0 + y, size);
+            int h = min(tile.rows - y, size - ring_row);
+            int x = 0;
+            while (x < tile.cols){
+                int ring_col = wrap(col0 + x, size);
+                int w = min(tile.cols - x, size - ring_col);
+                tile(Rect(x, y, w, h)).copyTo(ring(Rect(ring_col, ring_row, w, h)), mask(Rect(x, y, w, h)));
+                x += w;
+            }
+            y += h;
+        }
+    }
+public:
+    // extent: side of the map in meters
+    BevMap(const BevGrid& bev_grid, double extent)
+        : grid(bev_grid), size(max(1, static_cast<int>(ceil(extent / bev_grid.resolution)))),
+          top(0), left(0), placed(false), vehicle_x(0), vehicle_y(0), vehicle_yaw(0), frames(0){
+        ring = Mat::zeros(size, size, CV_8UC3);
+        LOG_INFO("Accumulated BEV map: " + to_string(size) + "x" + to_string(size) + " px ring over " + to_string(static_cast<int>(extent)) + "m");
+    }
+
+    // Add a BEV frame taken at `pose` (vehicle -> world, row-major 4x4). valid marks the BEV
+    // pixels the camera actually sees (IPMModel::validMask).
+    void accumulate(const Mat& bev, const Mat& valid, const double* pose){
+        vehicle_x = pose[3];
+        vehicle_y = pose[7];
+        vehicle_yaw = atan2(pose[4], pose[0]);
+        scroll(static_cast<long long>(floor(-vehicle_x / grid.resolution)),
+               static_cast<long long>(floor(-vehicle_y / grid.resolution)));
+
+        // footprint of the BEV frame in global map pixels, clipped to the window
+        double c = cos(vehicle_yaw), s = sin(vehicle_yaw);
+        double min_r = 1e18, max_r = -1e18, min_c = 1e18, max_c = -1e18;
+        double corners[4][2] = {{0, 0}, {double(bev.cols), 0}, {0, double(bev.rows)}, {double(bev.cols), double(bev.rows)}};
+        for (auto& corner : corners){
+            double vx, vy;
+            grid.toVehicle(corner[0] - 0.5, corner[1] - 0.5, vx, vy);
+            double wx = vehicle_x + c * vx - s * vy;
+            double wy = vehicle_y + s * vx + c * vy;
+            min_r = min(min_r, -wx / grid.resolution);
+            max_r = max(max_r, -wx / grid.resolution);
+            min_c = min(min_c, -wy / grid.resolution);
+            max_c = max(max_c, -wy / grid.resolution);
+        }
+        long long r0 = max(top, static_cast<long long>(floor(min_r)));
+        long long r1 = min(top + size, static_cast<long long>(ceil(max_r)) + 1);
+        long long c0 = max(left, static_cast<long long>(floor(min_c)));
+        long long c1 = min(left + size, static_cast<long long>(ceil(max_c)) + 1);
+        if (r1 <= r0 || c1 <= c0){
+            return;
+        }
+
+        // affine tile pixel -> BEV pixel from three points
+        double o_col, o_row, x_col, x_row, y_col, y_row;
+        toBev(static_cast<double>(c0), static_cast<double>(r0), o_col, o_row);
+        toBev(static_cast<double>(c0 + 1), static_cast<double>(r0), x_col, x_row);
+        toBev(static_cast<double>(c0), static_cast<double>(r0 + 1), y_col, y_row);
+        Mat affine = (Mat_<double>(2, 3) << x_col - o_col, y_col - o_col, o_col,
+                                            x_row - o_row, y_row - o_row, o_row);
+        Size tile_size(static_cast<int>(c1 - c0), static_cast<int>(r1 - r0));
+        Mat tile, tile_mask;
+        warpAffine(bev, tile, affine, tile_size, INTER_LINEAR | WARP_INVERSE_MAP, BORDER_CONSTANT);
+        warpAffine(valid, tile_mask, affine, tile_size, INTER_NEAREST | WARP_INVERSE_MAP, BORDER_CONSTANT);
+        blit(tile, tile_mask, r0, c0);
+        frames++;
+    }
+
+    // North-up view of the window with the vehicle in the middle, side x side pixels (the
+    // ring size when 0). Each ring quadrant is resized straight into its place in the view,
+    // so a small view never copies the whole ring.
+    void render(Mat& view, int side = 0) const {
+        side = side > 0 ? side : size;
+        view.create(side, side, CV_8UC3);
+        int ring_top = wrap(top, size), ring_left = wrap(left, size);
+        // ring rows [ring_top, size) are the top of the view, rows [0, ring_top) the bottom
+        int split_y = cvRound(static_cast<double>(size - ring_top) * side / size);
+        int split_x = cvRound(static_cast<double>(size - ring_left) * side / size);
+        Rect ring_rows[2] = {Rect(0, ring_top, 0, size - ring_top), Rect(0, 0, 0, ring_top)};
+        Rect ring_cols[2] = {Rect(ring_left, 0, size - ring_left, 0), Rect(0, 0, ring_left, 0)};
+        Rect view_rows[2] = {Rect(0, 0, 0, split_y), Rect(0, split_y, 0, side - split_y)};
+        Rect view_cols[2] = {Rect(0, 0, split_x, 0), Rect(split_x, 0, side - split_x, 0)};
+        for (int i = 0; i < 2; i++){
+            for (int j = 0; j < 2; j++){
+                Rect from(ring_cols[j].x, ring_rows[i].y, ring_cols[j].width, ring_rows[i].height);
+                Rect to(view_cols[j].x, view_rows[i].y, view_cols[j].width, view_rows[i].height);
+                if (from.area() == 0 || to.area() == 0){
+                    continue;
+                }
+                Mat dst = view(to);
+                if (from.size() == to.size()){
+                    ring(from).copyTo(dst);
+                } else {
+                    resize(ring(from), dst, to.size(), 0, 0, INTER_AREA);
+                }
+            }
+        }
+        // vehicle position and heading
+        Point center(side / 2, side / 2);
+        int length = max(4, static_cast<int>(4.0 / grid.resolution * side / size));
+        Point heading(center.x - static_cast<int>(length * sin(vehicle_yaw)), center.y - static_cast<int>(length * cos(vehicle_yaw)));
+        line(view, center, heading, Scalar(0, 0, 255), 2);
+        circle(view, center, 3, Scalar(0, 0, 255), FILLED);
+    }
+    Mat render(int side = 0) const {
+        Mat view;
+        render(view, side);
+        return view;
+    }
+    int framesAccumulated() const { return frames; }
+    size_t bytes() const { return ring.total() * ring.elemSize(); }
+};
+
+#endif // BEV_MAP_H
@@ -0,0 +1,126 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+// Performance tracker totals, carried over when a job resumes
+struct TrackerState {
+    int frame_count = 0;
+    double total_processing_time = 0;
+    double total_ipm_time = 0;
+    double total_pip_time = 0;
+};
+
+// Resume point of a long image-sequence job.
+// The output video is written as numbered segments (out.part0000.mp4, ...). A segment is
+// finalized (writer released) before the checkpoint that covers it is written, so every
+// segment listed in a checkpoint is a complete MP4 and a restarted job only redoes the
+// frames after next_index.
+struct JobCheckpoint {
+    string input_dir;
+    int file_count = 0;
+    int next_index = 0;     // first image index not covered by a committed segment
+    string last_file;       // image at next_index - 1, detects a changed input listing
+    int next_segment = 0;   // committed segments are 0 .. next_segment - 1
+    bool completed = false;
+    TrackerState tracker;
+
+    static string pathFor(const string& output_video_path){
+        return output_video_path + ".ckpt.yml";
+    }
+    // out.mp4 -> out.part0003.mp4
+    static string segmentPath(const string& output_video_path, int segment){
+        fs::path out(output_video_path);
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".part%04d", segment);
+        return (out.parent_path() / (out.stem().string() + suffix + out.extension().string())).string();
+    }
+    static string segmentListPath(const string& output_video_path){
+        return output_video_path + ".segments.txt";
+    }
+
+    bool load(const string& path){
+        if (!fs::exists(path)){
+            return false;
+        }
+        try {
+            FileStorage file(path, FileStorage::READ);
+            if (!file.isOpened()){
+                return false;
+            }
+            input_dir = (string)file["input_dir"];
+            file_count = (int)file["file_count"];
+            next_index = (int)file["next_index"];
+            last_file = (string)file["last_file"];
+            next_segment = (int)file["next_segment"];
+            completed = (int)file["completed"] != 0;
+            tracker.frame_count = (int)file["tracker_frame_count"];
+            tracker.total_processing_time = (double)file["tracker_total_processing_time"];
+            tracker.total_ipm_time = (double)file["tracker_total_ipm_time"];
+            tracker.total_pip_time = (double)file["tracker_total_pip_time"];
+            return true;
+        } catch(const exception& e){
+            LOG_ERROR("Failed to read checkpoint " + path + ": " + string(e.what()));
+            return false;
+        }
+    }
+    // written to a temp file and renamed so a crash mid-write keeps the previous checkpoint
+    bool save(const string& path) const {
+        string tmp_path = path + ".tmp.yml";
+        try {
+            FileStorage file(tmp_path, FileStorage::WRITE);
+            if (!file.isOpened()){
+                return false;
+            }
+            file << "input_dir" << input_dir;
+            file << "file_count" << file_count;
+            file << "next_index" << next_index;
+            file << "last_file" << last_file;
+            file << "next_segment" << next_segment;
+            file << "completed" << (completed ? 1 : 0);
+            file << "tracker_frame_count" << tracker.frame_count;
+            file << "tracker_total_processing_time" << tracker.total_processing_time;
+            file << "tracker_total_ipm_time" << tracker.total_ipm_time;
+            file << "tracker_total_pip_time" << tracker.total_pip_time;
+            file.release();
+            fs::rename(tmp_path, path);
+            return true;
+        } catch(const exception& e){
+            LOG_ERROR("Failed to write checkpoint " + path + ": " + string(e.what()));
+            return false;
+        }
+    }
+    // the checkpoint only applies to the same sorted listing it was taken on
+    bool matches(const string& dir, const vector<string>& image_files) const {
+        if (dir != input_dir || next_index > (int)image_files.size()){
+            return false;
+        }
+        return next_index == 0 || image_files[next_index - 1] == last_file;
+    }
+    // ffmpeg concat list of the committed segments, rewritten in full on every commit
+    bool writeSegmentList(const string& output_video_path) const {
+        string list_path = segmentListPath(output_video_path);
+        string tmp_path = list_path + ".tmp";
+        ofstream list(tmp_path);
+        for (int i = 0; i < next_segment; i++){
+            list << "file '" << fs::path(segmentPath(output_video_path, i)).filename().string() << "'\n";
+        }
+        list.close();
+        if (!list){
+            return false;
+        }
+        fs::rename(tmp_path, list_path);
+        return true;
+    }
+};
+
+#endif // CHECKPOINT_H
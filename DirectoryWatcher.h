@@ -0,0 +1,159 @@
+#ifndef DIRECTORY_WATCHER_H
+#define DIRECTORY_WATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "Logger.h"
+using namespace std;
+using namespace std::chrono;
+
+// Streams files out of a directory while a producer (waymo_extractor.py, a recorder) is
+// still writing into it. inotify reports files once they are closed after writing or renamed
+// into place; they are handed out in filename order. Up to `window` files are held back
+// so a few files finishing out of order still come out sorted, and a file never waits longer
+// than reorder_delay_ms. next() returns false after idle_timeout_ms without new files.
+// Files already there when the watch starts may still be open for writing: they stay pending
+// until their close-write arrives or the delay passes without one, even with a full window.
+// A path is handed out at most once.
+class DirectoryWatcher {
+private:
+    string dir;
+    function<bool(const string&)> accept;
+    int window;
+    int reorder_delay_ms;
+    int idle_timeout_ms;
+    int inotify_fd;
+    map<string, steady_clock::time_point> pending;   // path -> arrival, sorted by name
+    set<string> seen;
+    set<string> listed;     // from the startup listing, no close-write seen for them yet
+    string last_emitted;
+    steady_clock::time_point last_activity;
+
+    void add(const string& path, steady_clock::time_point arrival, bool from_event){
+        if (!accept(path)){
+            return;
+        }
+        if (seen.count(path)){
+            // close-write of a listed file: complete now, its delay starts over
+            if (from_event && listed.erase(path)){
+                if (pending.count(path)){
+                    pending[path] = arrival;
+                    last_activity = steady_clock::now();
+                } else {
+                    LOG_WARNING("File was still being written when it was processed: " + path);
+                }
+            }
+            return;
+        }
+        seen.insert(path);
+        pending[path] = arrival;
+        last_activity = steady_clock::now();
+    }
+    void readEvents(){
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (true){
+            ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+            if (len <= 0){
+                return;     // EAGAIN: drained
+            }
+            for (char* p = buffer; p < buffer + len; ){
+                inotify_event* event = reinterpret_cast<inotify_event*>(p);
+                if (event->len > 0 && !(event->mask & IN_ISDIR)){
+                    add(dir + "/" + event->name, steady_clock::now(), true);
+                }
+                if (event->mask & IN_Q_OVERFLOW){
+                    LOG_WARNING("inotify queue overflow in " + dir + ", some files may be missed");
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+public:
+    DirectoryWatcher(const string& directory, function<bool(const string&)> accept,
+                     int window = 8, int reorder_delay_ms = 500, int idle_timeout_ms = 30000)
+        : dir(directory), accept(accept), window(window), reorder_delay_ms(reorder_delay_ms),
+          idle_timeout_ms(idle_timeout_ms), inotify_fd(-1){
+        while (dir.size() > 1 && dir.back() == '/'){
+            dir.pop_back();
+        }
+    }
+    ~DirectoryWatcher(){
+        if (inotify_fd >= 0){
+            close(inotify_fd);
+        }
+    }
+    // Start watching. Call before listing the directory so nothing falls in between, then
+    // pass the listing to addExisting().
+    bool start(){
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0 || inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+            LOG_ERROR("Unable to watch directory: " + dir);
+            return false;
+        }
+        last_activity = steady_clock::now();
+        LOG_INFO("Watching " + dir + " for new images (window " + to_string(window) + ", idle timeout " +
+                 to_string(idle_timeout_ms / 1000) + "s)");
+        return true;
+    }
+    // files that were there before the watch started; one of them may still be written to,
+    // so they wait out the same delay as new files
+    void addExisting(const vector<string>& files){
+        for (const string& path : files){
+            if (!seen.count(path)){
+                listed.insert(path);
+            }
+            add(path, steady_clock::now(), false);
+        }
+    }
+    // blocks until the next file is ready, false once the directory went idle
+    bool next(string& path){
+        while (true){
+            // queued close-writes first, they decide whether a listed file is complete
+            readEvents();
+            auto now = steady_clock::now();
+            int wait_ms;
+            if (!pending.empty()){
+                auto oldest = steady_clock::time_point::max();
+                for (const auto& entry : pending){
+                    oldest = min(oldest, entry.second);
+                }
+                auto held_ms = duration_cast<milliseconds>(now - oldest).count();
+                // the next file in order is listed and may still be written: wait out its delay
+                auto first_ms = duration_cast<milliseconds>(now - pending.begin()->second).count();
+                bool settling = listed.count(pending.begin()->first) && first_ms < reorder_delay_ms;
+                if (settling){
+                    held_ms = first_ms;
+                } else if ((int)pending.size() > window || held_ms >= reorder_delay_ms){
+                    path = pending.begin()->first;
+                    pending.erase(pending.begin());
+                    if (!last_emitted.empty() && path < last_emitted){
+                        LOG_WARNING("File arrived outside the reorder window: " + path);
+                    }
+                    last_emitted = path;
+                    return true;
+                }
+                wait_ms = reorder_delay_ms - static_cast<int>(held_ms);
+            } else {
+                auto idle_ms = duration_cast<milliseconds>(now - last_activity).count();
+                if (idle_ms >= idle_timeout_ms){
+                    LOG_INFO("No new files in " + dir + " for " + to_string(idle_timeout_ms / 1000) + "s, stopping");
+                    return false;
+                }
+                wait_ms = idle_timeout_ms - static_cast<int>(idle_ms);
+            }
+            pollfd pfd = {inotify_fd, POLLIN, 0};
+            if (poll(&pfd, 1, max(1, wait_ms)) > 0){
+                readEvents();
+            }
+        }
+    }
+};
+
+#endif // DIRECTORY_WATCHER_H
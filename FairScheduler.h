@@ -0,0 +1,215 @@
+#ifndef FAIR_SCHEDULER_H
+#define FAIR_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Logger.h"
+#include "AsyncExecutor.h"
+using namespace std;
+
+// Shares the worker pool of an IoLoop between streams. Frame jobs wait here rather than in
+// the pool's queues: at most one job per worker is handed to the pool, and the next one
+// comes from the backlogged stream with the least weighted service so far (start-time fair
+// queuing on measured CPU ms), so a stream with weight 2 gets twice the CPU of a stream
+// with weight 1 while both have work, and a fast source can't starve the others.
+// A stream with a latency target sheds load: a job whose frame was read longer than the
+// target ago when its turn comes is dropped instead of processed late.
+// Per-stream metrics (frames, drops, end-to-end latency, CPU share) are kept here too.
+// Everything except the job bodies runs on the loop thread.
+class FairScheduler {
+private:
+    using Clock = chrono::steady_clock;
+    struct Job;
+    struct Stream {
+        string name;
+        double weight;
+        double target_ms;
+        double vtime = 0;           // CPU ms received / weight
+        deque<Job*> queue;
+        int running = 0;
+        // metrics
+        long long read = 0;
+        long long processed = 0;
+        long long dropped = 0;
+        long long written = 0;
+        long long late = 0;         // written after the latency target
+        double busy_ms = 0;
+        double wait_ms = 0;         // queued here before a worker took the job
+        vector<float> latencies;    // last latency_window end-to-end latencies
+        double latency_sum = 0;
+    };
+    static constexpr size_t latency_window = 512;
+    IoLoop& loop;
+    int max_running;
+    int running;
+    vector<Stream> streams;
+    Clock::time_point started;
+    Clock::time_point last_report;
+
+    static double msSince(Clock::time_point start){
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+    // smallest virtual time among streams with work, where an idle stream rejoins
+    double virtualClock() const {
+        double clock = -1;
+        for (const Stream& s : streams){
+            if (!s.queue.empty() || s.running > 0){
+                clock = clock < 0 ? s.vtime : min(clock, s.vtime);
+            }
+        }
+        return max(0.0, clock);
+    }
+    void dispatch(){
+        while (running < max_running){
+            Stream* best = nullptr;
+            for (Stream& s : streams){
+                if (!s.queue.empty() && (!best || s.vtime < best->vtime)){
+                    best = &s;
+                }
+            }
+            if (!best){
+                return;
+            }
+            Job* job = best->queue.front();
+            best->queue.pop_front();
+            best->wait_ms += msSince(job->queued);
+            // the target is end to end: time in the reader and channels counts as well
+            if (best->target_ms > 0 && msSince(job->read_at) > best->target_ms){
+                best->dropped++;
+                job->ran = false;
+                loop.resumeLater(job->waiting);
+                continue;
+            }
+            running++;
+            best->running++;
+            job->started = true;
+            IoLoop* io = &loop;
+            loop.workers().submit([io, job]{
+                auto start = Clock::now();
+                try {
+                    job->fn();
+                    job->ran = true;
+                } catch(const exception& e){
+                    LOG_ERROR("Stream job failed: " + string(e.what()));
+                    job->ran = false;
+                }
+                job->cost_ms = msSince(start);
+                io->post(job->waiting);
+            });
+        }
+    }
+    struct Job {
+        FairScheduler& scheduler;
+        int stream;
+        function<void()> fn;
+        Clock::time_point read_at;  // when the frame was read
+        Clock::time_point queued;
+        coroutine_handle<> waiting;
+        bool ran = false;
+        bool started = false;       // handed to a worker (vs dropped)
+        double cost_ms = 0;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h){
+            waiting = h;
+            queued = Clock::now();
+            scheduler.enqueue(this);
+        }
+        // back on the loop thread: account the work and start the next job
+        bool await_resume(){
+            scheduler.complete(this);
+            return ran;
+        }
+    };
+    void enqueue(Job* job){
+        Stream& s = streams[job->stream];
+        if (s.queue.empty() && s.running == 0){
+            // no credit for time spent idle
+            s.vtime = max(s.vtime, virtualClock());
+        }
+        s.queue.push_back(job);
+        dispatch();
+    }
+    void complete(Job* job){
+        Stream& s = streams[job->stream];
+        if (job->started){
+            running--;
+            s.running--;
+            s.processed += job->ran;
+            s.busy_ms += job->cost_ms;
+            s.vtime += job->cost_ms / s.weight;
+        }
+        dispatch();
+    }
+public:
+    FairScheduler(IoLoop& loop, int max_running)
+        : loop(loop), max_running(max(1, max_running)), running(0), started(Clock::now()), last_report(Clock::now()){}
+    FairScheduler(const FairScheduler&) = delete;
+    FairScheduler& operator=(const FairScheduler&) = delete;
+
+    int addStream(const string& name, double weight = 1.0, double target_ms = 0){
+        Stream s;
+        s.name = name;
+        s.weight = weight > 0 ? weight : 1.0;
+        s.target_ms = max(0.0, target_ms);
+        s.vtime = virtualClock();
+        s.latencies.reserve(latency_window);
+        streams.push_back(move(s));
+        return static_cast<int>(streams.size()) - 1;
+    }
+    // co_await scheduler.run(stream, read_at, fn): fn() on a worker when it's the stream's
+    // turn; false when the frame read at read_at is past the latency target (or fn threw)
+    Job run(int stream, Clock::time_point read_at, function<void()> fn){
+        return Job{*this, stream, move(fn), read_at, Clock::time_point(), nullptr};
+    }
+
+    void frameRead(int stream){ streams[stream].read++; }
+    // a frame left the stream, latency_ms after it was read
+    void frameWritten(int stream, double latency_ms){
+        Stream& s = streams[stream];
+        s.written++;
+        s.late += s.target_ms > 0 && latency_ms > s.target_ms;
+        s.latency_sum += latency_ms;
+        if (s.latencies.size() < latency_window){
+            s.latencies.push_back(static_cast<float>(latency_ms));
+        } else {
+            s.latencies[s.written % latency_window] = static_cast<float>(latency_ms);
+        }
+    }
+    // log the metrics when every_s seconds have passed since the last report
+    void maybeReport(double every_s){
+        if (every_s > 0 && msSince(last_report) >= every_s * 1000.0){
+            logSummary("Streams");
+        }
+    }
+    void logSummary(const string& title){
+        last_report = Clock::now();
+        double elapsed_s = max(1e-3, msSince(started) / 1000.0);
+        double busy = 0;
+        for (const Stream& s : streams){
+            busy += s.busy_ms;
+        }
+        LOG_INFO("=== " + title + " (" + to_string(streams.size()) + " streams, " + to_string(max_running) + " workers) ===");
+        for (const Stream& s : streams){
+            vector<float> sorted = s.latencies;
+            sort(sorted.begin(), sorted.end());
+            double p95 = sorted.empty() ? 0 : sorted[sorted.size() * 95 / 100];
+            double avg = s.written ? s.latency_sum / s.written : 0;
+            double n = s.processed ? static_cast<double>(s.processed) : 1.0;
+            LOG_INFO("  " + s.name + " (weight " + to_string(s.weight) +
+                     (s.target_ms > 0 ? ", target " + to_string(static_cast<int>(s.target_ms)) + "ms" : "") + "): " +
+                     to_string(s.read) + " read, " + to_string(s.written) + " written, " + to_string(s.dropped) + " dropped, " +
+                     to_string(s.written / elapsed_s) + " fps, latency avg " + to_string(avg) + "ms p95 " + to_string(p95) + "ms" +
+                     (s.target_ms > 0 ? ", " + to_string(s.late) + " late" : "") +
+                     ", work " + to_string(s.busy_ms / n) + "ms/frame, queued " + to_string(s.wait_ms / max(1.0, static_cast<double>(s.processed + s.dropped))) +
+                     "ms, cpu share " + to_string(static_cast<int>(busy > 0 ? 100.0 * s.busy_ms / busy : 0)) + "%");
+        }
+    }
+};
+
+#endif // FAIR_SCHEDULER_H
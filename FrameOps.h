@@ -0,0 +1,153 @@
+#ifndef FRAME_OPS_H
+#define FRAME_OPS_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Logger.h"
+#include "IPMModel.h"
+#include "ResultCache.h"
+using namespace cv;
+using namespace std;
+using namespace std::chrono;
+
+// The general per-frame operations of main.cpp: IPM (heuristic warp or IPMModel), the cached
+// and pyramid variants, and the picture-in-picture composite. Kept here so pipeline_bench
+// measures the same functions the program runs.
+
+// Function to perform Inverse Perspective Mapping
+inline Mat IPM(const Mat& image, const IPMConfig& config = IPMConfig()) {
+    auto start_time = high_resolution_clock::now();
+
+    int height = image.rows;
+    int width = image.cols;
+    LOG_DEBUG("IPM: Processing frame " + to_string(width) + "x" + to_string(height));
+
+    if (config.metric || config.mip_levels > 0){
+        // metric grid and/or anti-aliased sampling: warp through the model's precomputed maps
+        thread_local IPMModel model;
+        model.configure(config, image.size());
+        Mat bev = model.warp(image);
+        return bev.empty() ? image : bev;
+    }
+    try {
+        // Compute and apply the perspective transformation (IPMModel.h)
+        Mat matrix = ipmMatrix(width, height, config);
+        Mat warped_image;
+        warpPerspective(image, warped_image, matrix, Size(width, height * 2));
+        
+        // Resize back to original dimensions
+        Mat final_warped_image;
+        resize(warped_image, final_warped_image, Size(width, height));
+
+        auto end_time = high_resolution_clock::now();
+        auto duration = duration_cast<milliseconds>(end_time - start_time);
+        double ms = duration.count() / 1000.0;
+        
+        // Log performances
+        if (ms > 10.0){
+            LOG_WARNING("IPM processing slow: " + to_string(ms) + "ms");
+        }
+        return final_warped_image;
+        
+    } catch(const exception& e){
+        LOG_ERROR("IPM failed: " + string(e.what()));
+        return image; // return original image on failure
+    }
+}
+
+// IPM() plus `levels` levels at half the resolution of the one above, produced in the same
+// tile pass (IPMModel::warpPyramid). pyramid[0] is the returned BEV.
+inline Mat IPMPyramid(const Mat& image, vector<Mat>& pyramid, int levels, const IPMConfig& config = IPMConfig()){
+    thread_local IPMModel model;
+    model.configure(config, image.size());
+    Mat bev = model.warpPyramid(image, pyramid, levels);
+    if (bev.empty()){
+        pyramid.assign(1, image);
+        return image;
+    }
+    return bev;
+}
+// Smallest pyramid level at least `height` rows high (the PIP overlay size), so the overlay
+// is resized from a level close to its size instead of the full BEV
+inline const Mat& pyramidLevel(const vector<Mat>& pyramid, const Mat& bev, int height){
+    const Mat* level = &bev;
+    for (size_t l = 1; l < pyramid.size() && pyramid[l].rows >= height; l++){
+        level = &pyramid[l];
+    }
+    return *level;
+}
+// IPM through the result cache: returns the stored BEV on a hit, otherwise warps and stores it
+// (lookup = false when the caller already checked the cache for this key)
+// With a pyramid (levels > 0) a cache hit only stores the full BEV, the lower levels are
+// rebuilt from it with the same box downsample
+inline Mat cachedIPM(const Mat& image, ResultCache& cache, const CacheKey& key, const IPMConfig& config, bool lookup = true,
+                     vector<Mat>* pyramid = nullptr, int levels = 0){
+    Mat bev;
+    if (lookup && cache.load(key, bev)){
+        if (pyramid && levels > 0){
+            pyramid->resize(1 + min(levels, 6));
+            (*pyramid)[0] = bev;
+            for (size_t l = 1; l < pyramid->size(); l++){
+                IPMModel::boxDownsample((*pyramid)[l - 1], (*pyramid)[l]);
+            }
+        }
+        return bev;
+    }
+    auto start = high_resolution_clock::now();
+    bev = (pyramid && levels > 0) ? IPMPyramid(image, *pyramid, levels, config) : IPM(image, config);
+    // IPM hands back the input on failure, don't cache that
+    if (bev.data != image.data && cache.enabled()){
+        cache.recordWarp(duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0);
+        cache.store(key, bev);
+    }
+    return bev;
+}
+
+// Function to create picture-in-picture overlay
+inline Mat pictureInPicture(Mat main_image, const Mat& overlay_image, 
+                           int img_ratio = 3, int border_size = 3, 
+                           int x_margin = 30, int y_offset_adjust = -100) {
+    
+    if (main_image.empty() || overlay_image.empty()) {
+        LOG_ERROR("PIP: One or both images are empty");
+        return main_image; // is this necessary?
+    }
+    try {
+        // Resize the overlay image to 1/img_ratio of the main image height
+        int new_height = main_image.rows / img_ratio;
+        int new_width = static_cast<int>(new_height * (static_cast<double>(overlay_image.cols) / overlay_image.rows));
+        
+        Mat overlay_resized;
+        resize(overlay_image, overlay_resized, Size(new_width, new_height));
+        
+        // Add a white border to the overlay image
+        Mat overlay_with_border;
+        copyMakeBorder(overlay_resized, overlay_with_border, 
+                    border_size, border_size, border_size, border_size,
+                    BORDER_CONSTANT, Scalar(255, 255, 255));
+        
+        // Determine overlay position
+        int x_offset = main_image.cols - overlay_with_border.cols - x_margin;
+        int y_offset = (main_image.rows / 2) - overlay_with_border.rows + y_offset_adjust;
+        
+        // Ensure the overlay fits within the main image bounds
+        if (x_offset >= 0 && y_offset >= 0 && 
+            x_offset + overlay_with_border.cols <= main_image.cols &&
+            y_offset + overlay_with_border.rows <= main_image.rows) {
+            
+            // Create ROI and copy overlay
+            Rect roi(x_offset, y_offset, overlay_with_border.cols, overlay_with_border.rows);
+            overlay_with_border.copyTo(main_image(roi));
+        }
+        
+        return main_image;
+    } catch(const exception& e){
+        LOG_ERROR("PIP failed: " + string(e.what()));
+        return main_image;
+    }
+}
+
+#endif // FRAME_OPS_H
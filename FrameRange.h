@@ -0,0 +1,68 @@
+#ifndef FRAME_RANGE_H
+#define FRAME_RANGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Subset of an input to process: frames [start, end) taking every stride-th frame.
+// Bounds can also be given in seconds, they are turned into frame indices with the input
+// frame rate by resolve(). Sources use it to skip frames before decoding them: index skip
+// for file lists, seek/grab for video.
+struct FrameRange {
+    int start = 0;
+    int end = -1;               // exclusive, -1 = until the end of the input
+    int stride = 1;
+    double start_time = -1;     // seconds, overrides start when >= 0
+    double end_time = -1;       // seconds, overrides end when >= 0
+
+    bool isFull() const {
+        return start == 0 && end < 0 && stride <= 1 && start_time < 0 && end_time < 0;
+    }
+    // index bounds for an input with the given fps and frame count (total < 0 = unknown)
+    FrameRange resolve(double fps, int total) const {
+        FrameRange r = *this;
+        if (start_time >= 0 && fps > 0){
+            r.start = static_cast<int>(llround(start_time * fps));
+        }
+        if (end_time >= 0 && fps > 0){
+            r.end = static_cast<int>(llround(end_time * fps));
+        }
+        r.start_time = r.end_time = -1;
+        r.stride = max(1, stride);
+        r.start = max(0, r.start);
+        if (total >= 0){
+            r.end = (r.end < 0) ? total : min(r.end, total);
+            r.start = min(r.start, r.end);
+        }
+        return r;
+    }
+    // number of selected frames of a resolved range
+    int count() const {
+        if (end < 0){
+            return -1;
+        }
+        return (end - start + stride - 1) / stride;
+    }
+    // whether frame `index` is selected (resolve() first)
+    bool contains(int index) const {
+        return index >= start && (end < 0 || index < end) && (index - start) % stride == 0;
+    }
+    // selected items of a list (resolve() first)
+    template<typename T>
+    vector<T> select(const vector<T>& items) const {
+        vector<T> selected;
+        int last = (end < 0) ? static_cast<int>(items.size()) : min(end, static_cast<int>(items.size()));
+        for (int i = start; i < last; i += stride){
+            selected.push_back(items[i]);
+        }
+        return selected;
+    }
+    string describe() const {
+        return "[" + to_string(start) + ", " + (end < 0 ? string("end") : to_string(end)) + ") stride " + to_string(stride);
+    }
+};
+
+#endif // FRAME_RANGE_H
@@ -0,0 +1,323 @@
+#ifndef FRAME_SINKS_H
+#define FRAME_SINKS_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "MemoryBudget.h"
+using namespace cv;
+using namespace std;
+
+// One consumer of the finished output frames (the composited frame that goes into the MP4)
+class FrameSink {
+public:
+    virtual ~FrameSink(){}
+    virtual bool open() = 0;
+    // frame_index counts the frames pushed to the fan-out (from FrameSinks' first_index), so
+    // sinks can subsample
+    virtual bool wants(int frame_index) const { (void)frame_index; return true; }
+    virtual void write(const Mat& frame, int frame_index) = 0;
+    virtual void close() = 0;
+    virtual string describe() const = 0;
+};
+
+// MP4 at the given size (the full output, or a downscaled preview when smaller than the frames)
+class VideoFileSink : public FrameSink {
+private:
+    string path;
+    double fps;
+    Size size;
+    VideoWriter writer;
+    Mat scaled;
+public:
+    VideoFileSink(const string& path, double fps, Size size) : path(path), fps(fps), size(size){}
+    bool open() override {
+        if (!writer.open(path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, size)){
+            LOG_ERROR("Unable to create output video file: " + path);
+            return false;
+        }
+        return true;
+    }
+    // finish the current file and continue in another one (checkpoint segments)
+    bool reopen(const string& new_path){
+        writer.release();
+        path = new_path;
+        return open();
+    }
+    void write(const Mat& frame, int) override {
+        if (frame.size() == size){
+            writer.write(frame);
+            return;
+        }
+        resize(frame, scaled, size, 0, 0, INTER_AREA);
+        writer.write(scaled);
+    }
+    void close() override { writer.release(); }
+    string describe() const override { return "video " + path + " (" + to_string(size.width) + "x" + to_string(size.height) + ")"; }
+};
+
+// JPEG thumbnail of every n-th frame into a directory
+class JpegThumbnailSink : public FrameSink {
+private:
+    string directory;
+    int every;
+    int width;
+    Mat scaled;
+public:
+    JpegThumbnailSink(const string& directory, int every, int width)
+        : directory(directory), every(max(1, every)), width(width){}
+    bool open() override {
+        error_code ec;
+        filesystem::create_directories(directory, ec);
+        if (ec){
+            LOG_ERROR("Unable to create thumbnail directory " + directory + ": " + ec.message());
+            return false;
+        }
+        return true;
+    }
+    bool wants(int frame_index) const override { return frame_index % every == 0; }
+    void write(const Mat& frame, int frame_index) override {
+        int height = max(1, static_cast<int>(static_cast<double>(frame.rows) * width / frame.cols));
+        resize(frame, scaled, Size(width, height), 0, 0, INTER_AREA);
+        char name[32];
+        snprintf(name, sizeof(name), "thumb_%06d.jpg", frame_index);
+        if (!imwrite((filesystem::path(directory) / name).string(), scaled, {IMWRITE_JPEG_QUALITY, 85})){
+            LOG_WARNING("Failed to write thumbnail " + string(name));
+        }
+    }
+    void close() override {}
+    string describe() const override { return "thumbnails " + directory + " (every " + to_string(every) + " frames)"; }
+};
+
+// Latest frame in a POSIX shared memory object (/dev/shm/<name>) for a viewer process.
+// Layout: ShmFrameHeader, then the pixels (rows * step bytes). sequence is a seqlock: odd
+// while the frame is being written, a reader copies the pixels and retries if sequence
+// changed or was odd.
+struct ShmFrameHeader {
+    uint32_t magic;             // 'IPMF'
+    uint32_t version;
+    atomic<uint64_t> sequence;
+    uint64_t frame_index;
+    int32_t width, height, type, step;
+};
+class SharedMemorySink : public FrameSink {
+private:
+    string name;
+    size_t capacity;            // pixel bytes reserved after the header
+    int fd;
+    unsigned char* base;
+    size_t mapped;
+public:
+    SharedMemorySink(const string& name, size_t capacity)
+        : name(name[0] == '/' ? name : "/" + name), capacity(capacity), fd(-1), base(nullptr), mapped(0){}
+    ~SharedMemorySink(){ close(); }
+    bool open() override {
+        mapped = sizeof(ShmFrameHeader) + capacity;
+        fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(mapped)) != 0){
+            LOG_ERROR("Unable to create shared memory " + name);
+            return false;
+        }
+        void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED){
+            LOG_ERROR("Unable to map shared memory " + name);
+            return false;
+        }
+        base = static_cast<unsigned char*>(memory);
+        ShmFrameHeader* header = new (base) ShmFrameHeader();
+        header->magic = 0x464D5049;
+        header->version = 1;
+        header->sequence.store(0);
+        return true;
+    }
+    void write(const Mat& frame, int frame_index) override {
+        size_t bytes = frame.total() * frame.elemSize();
+        if (!base || bytes > capacity){
+            return;
+        }
+        ShmFrameHeader* header = reinterpret_cast<ShmFrameHeader*>(base);
+        uint64_t seq = header->sequence.load(memory_order_relaxed);
+        header->sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        header->frame_index = static_cast<uint64_t>(frame_index);
+        header->width = frame.cols;
+        header->height = frame.rows;
+        header->type = frame.type();
+        header->step = static_cast<int32_t>(frame.cols * frame.elemSize());
+        Mat pixels(frame.rows, frame.cols, frame.type(), base + sizeof(ShmFrameHeader));
+        frame.copyTo(pixels);
+        header->sequence.store(seq + 2, memory_order_release);
+    }
+    void close() override {
+        if (base){
+            munmap(base, mapped);
+            base = nullptr;
+        }
+        if (fd >= 0){
+            ::close(fd);
+            shm_unlink(name.c_str());
+            fd = -1;
+        }
+    }
+    string describe() const override { return "shared memory " + name; }
+};
+
+// Fan-out of one output frame to several sinks. Every sink has its own thread and bounded
+// queue, so a slow encoder only holds up the producer through its own queue: a lossless
+// sink (the MP4s) blocks push() when its queue is full, a lossy one (thumbnails, shared
+// memory) drops its oldest queued frame instead. Frames are shared, not copied: the caller
+// must not write into a pushed Mat afterwards. With a MemoryBudget every pushed frame holds
+// its bytes until the last sink is done with it, and push() waits for room in the budget.
+class FrameSinks {
+private:
+    struct Entry {
+        int index;
+        Mat frame;
+        shared_ptr<MemoryLease> lease;
+    };
+    struct Worker {
+        unique_ptr<FrameSink> sink;
+        size_t depth;
+        bool lossy;
+        mutex mtx;
+        condition_variable cv;
+        deque<Entry> queue;
+        bool busy = false;
+        bool stopping = false;
+        int written = 0;
+        int dropped = 0;
+        double stall_ms = 0;    // producer time spent waiting on this sink
+        thread worker;
+    };
+    vector<unique_ptr<Worker>> workers;
+    int frame_index;
+    MemoryBudget* budget;
+
+    static void run(Worker* w){
+        unique_lock<mutex> lock(w->mtx);
+        while (true){
+            w->cv.wait(lock, [&]{ return w->stopping || !w->queue.empty(); });
+            if (w->queue.empty()){
+                return;
+            }
+            Entry item = move(w->queue.front());
+            w->queue.pop_front();
+            w->busy = true;
+            w->cv.notify_all();
+            lock.unlock();
+            try {
+                w->sink->write(item.frame, item.index);
+            } catch(const exception& e){
+                LOG_ERROR("Sink " + w->sink->describe() + " failed: " + string(e.what()));
+            }
+            item = Entry();
+            lock.lock();
+            w->written++;
+            w->busy = false;
+            w->cv.notify_all();
+        }
+    }
+public:
+    // first_index: index of the first pushed frame (a resumed job continues the numbering)
+    explicit FrameSinks(MemoryBudget* budget = nullptr, int first_index = 0) : frame_index(first_index), budget(budget){}
+    ~FrameSinks(){ close(); }
+    FrameSinks(const FrameSinks&) = delete;
+    FrameSinks& operator=(const FrameSinks&) = delete;
+
+    // opens the sink and starts its thread; returns the sink (owned here) or nullptr
+    template<typename Sink>
+    Sink* add(Sink* sink, size_t depth, bool lossy){
+        unique_ptr<Worker> w(new Worker());
+        w->sink.reset(sink);
+        if (!sink->open()){
+            return nullptr;
+        }
+        w->depth = max(size_t(1), depth);
+        w->lossy = lossy;
+        w->worker = thread(&FrameSinks::run, w.get());
+        LOG_INFO("Output sink: " + sink->describe() + (lossy ? ", drops when behind" : ""));
+        workers.push_back(move(w));
+        return sink;
+    }
+    void push(const Mat& frame){
+        int index = frame_index++;
+        shared_ptr<MemoryLease> lease;
+        if (budget && any_of(workers.begin(), workers.end(), [&](const unique_ptr<Worker>& w){ return w->sink->wants(index); })){
+            lease = make_shared<MemoryLease>(budget, frame.total() * frame.elemSize(), "output");
+        }
+        for (auto& w : workers){
+            if (!w->sink->wants(index)){
+                continue;
+            }
+            unique_lock<mutex> lock(w->mtx);
+            if (w->queue.size() >= w->depth){
+                if (w->lossy){
+                    w->queue.pop_front();
+                    w->dropped++;
+                } else {
+                    auto start = chrono::steady_clock::now();
+                    w->cv.wait(lock, [&]{ return w->queue.size() < w->depth; });
+                    w->stall_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                }
+            }
+            w->queue.push_back(Entry{index, frame, lease});
+            w->cv.notify_all();
+        }
+    }
+    // wait until every sink has written everything pushed so far
+    void flush(){
+        for (auto& w : workers){
+            unique_lock<mutex> lock(w->mtx);
+            w->cv.wait(lock, [&]{ return w->queue.empty() && !w->busy; });
+        }
+    }
+    // drain, stop the threads and close the sinks (the counters stay for logSummary)
+    void close(){
+        for (auto& w : workers){
+            if (!w->worker.joinable()){
+                continue;
+            }
+            {
+                lock_guard<mutex> lock(w->mtx);
+                w->stopping = true;
+                w->cv.notify_all();
+            }
+            w->worker.join();
+            w->sink->close();
+        }
+    }
+    void logSummary() const {
+        for (auto& w : workers){
+            lock_guard<mutex> lock(w->mtx);
+            LOG_INFO("Sink " + w->sink->describe() + ": " + to_string(w->written) + " frames written, " +
+                     to_string(w->dropped) + " dropped, producer stalled " + to_string(static_cast<int>(w->stall_ms)) + "ms");
+        }
+    }
+    // frames the lossy sinks dropped so far
+    long long dropped() const {
+        long long total = 0;
+        for (auto& w : workers){
+            lock_guard<mutex> lock(w->mtx);
+            total += w->dropped;
+        }
+        return total;
+    }
+    bool empty() const { return workers.empty(); }
+};
+
+#endif // FRAME_SINKS_H
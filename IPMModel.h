@@ -0,0 +1,528 @@
+#ifndef IPM_MODEL_H
+#define IPM_MODEL_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BevGrid.h"
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+
+// IPM parameters (hard-coded need to be fixed)
+struct IPMConfig {
+    int param1 = 570;
+    int param2 = 35;
+    int mip_levels = 0;     // anti-aliased warp from a source pyramid with this many levels, 0 = plain bilinear
+    // metric BEV: ground-plane warp of a calibrated camera onto `grid` instead of param1/param2
+    bool metric = false;
+    WaymoCameraCalibration calibration;
+    BevGrid grid;
+
+    // bump when the warp itself changes so cached BEVs get invalidated
+    static const int version = 1;
+    uint64_t hash() const {
+        int64_t fields[] = {version, param1, param2, mip_levels, metric};
+        uint64_t h = hashBytes(fields, sizeof(fields));
+        if (metric){
+            h = hashBytes(calibration.intrinsic, sizeof(calibration.intrinsic), h ^ grid.hash());
+            h = hashBytes(calibration.extrinsic, sizeof(calibration.extrinsic), h);
+        }
+        return h;
+    }
+};
+
+// Camera calibration from an OpenCV YAML/JSON file, as written by waymo_extractor.py:
+// f_u, f_v, c_u, c_v, width, height and a 4x4 camera -> vehicle `extrinsic` matrix
+// (Waymo camera frame: x forward, y left, z up)
+inline bool loadCameraCalibration(const string& path, WaymoCameraCalibration& calib){
+    try {
+        FileStorage file(path, FileStorage::READ);
+        if (!file.isOpened()){
+            LOG_ERROR("Unable to open calibration file: " + path);
+            return false;
+        }
+        const char* intrinsics[] = {"f_u", "f_v", "c_u", "c_v", "k1", "k2", "p1", "p2", "k3"};
+        for (int i = 0; i < 9; i++){
+            FileNode node = file[intrinsics[i]];
+            calib.intrinsic[i] = node.empty() ? 0.0 : static_cast<double>(node);
+        }
+        calib.width = static_cast<int>(file["width"]);
+        calib.height = static_cast<int>(file["height"]);
+        if (!file["name"].empty()){
+            calib.name = static_cast<int>(file["name"]);
+        }
+        Mat extrinsic;
+        file["extrinsic"] >> extrinsic;
+        if (extrinsic.rows != 4 || extrinsic.cols != 4 || calib.intrinsic[0] <= 0 || calib.intrinsic[1] <= 0){
+            LOG_ERROR("Calibration file needs f_u, f_v, c_u, c_v and a 4x4 extrinsic: " + path);
+            return false;
+        }
+        extrinsic.convertTo(extrinsic, CV_64F);
+        for (int i = 0; i < 16; i++){
+            calib.extrinsic[i] = extrinsic.at<double>(i / 4, i % 4);
+        }
+        return true;
+    } catch(const exception& e){
+        LOG_ERROR("Invalid calibration file " + path + ": " + string(e.what()));
+        return false;
+    }
+}
+
+// Perspective matrix of the heuristic IPM: lower half of a width x height image onto a
+// width x (2 * height) canvas, which IPM() then scales back to width x height
+inline Mat ipmMatrix(int width, int height, const IPMConfig& config){
+    // Define source points for perspective transformation
+    vector<Point2f> original_points = {
+        Point2f(0, (height / 2) + config.param2),          // Top-left of the lower half
+        Point2f(width, (height / 2) + config.param2),      // Top-right of the lower half
+        Point2f(width, height),                            // Bottom-right corner
+        Point2f(0, height)                                 // Bottom-left corner
+    };
+    // Define destination points for perspective transformation
+    vector<Point2f> destination_points = {
+        Point2f(0, 0),                                     // Top-left corner
+        Point2f(width, 0),                                 // Top-right corner
+        Point2f(width - config.param1, height * 2),        // Bottom-right corner
+        Point2f(config.param1, height * 2)                 // Bottom-left corner
+    };
+    return getPerspectiveTransform(original_points, destination_points);
+}
+
+// SoA point buffers for batch projection. valid is 0 for points without a projection
+// (above the horizon, behind the camera).
+struct PointBatch {
+    vector<float> x, y;
+    vector<uint8_t> valid;
+    void resize(size_t n){ x.resize(n); y.resize(n); valid.resize(n); }
+    size_t size() const { return x.size(); }
+};
+
+// Ground-plane IPM as a BEV <-> image homography plus the remap maps it expands into.
+// Built either from the heuristic IPMConfig (BEV the size of the image) or from a Waymo
+// camera calibration onto a metric BevGrid. Everything is computed once per configuration
+// and image size, so a frame costs one remap and point projection reuses the same matrices.
+// BEV cells whose ground point is behind the camera or outside the image stay black.
+//
+// With mip levels the far field, where one BEV pixel covers many source pixels, is sampled
+// from a smaller level of a per-frame source pyramid instead of aliasing. The level of every
+// BEV pixel comes from the footprint of the homography there and is stored next to the map
+// (whose coordinates are already scaled to that level), so a frame costs the pyramid plus
+// about one remap: each tile remaps once per level it contains.
+class IPMModel {
+private:
+    BevGrid grid;           // metric grid (calibrated models only)
+    Size bev_size;
+    Size image_size;
+    double H[9];            // BEV pixel -> image pixel
+    double H_inv[9];        // image pixel -> BEV pixel
+    Mat map_xy, map_frac;   // convertMaps() output for remap
+    Mat valid;              // CV_8UC1, 255 where the BEV cell is seen by the camera
+    vector<uint8_t> tile_visible;   // per tile: any cell seen by the camera
+    int mip_levels;
+    Mat level_map;                  // CV_8UC1 source pyramid level per BEV pixel (mip_levels > 0)
+    vector<uint8_t> tile_level_min, tile_level_max;
+    uint64_t key;
+
+    void buildMaps(){
+        Mat map_x(bev_size.height, bev_size.width, CV_32FC1);
+        Mat map_y(bev_size.height, bev_size.width, CV_32FC1);
+        valid = Mat::zeros(bev_size.height, bev_size.width, CV_8UC1);
+        level_map = Mat::zeros(bev_size.height, bev_size.width, CV_8UC1);
+        for (int row = 0; row < map_x.rows; row++){
+            float* mx = map_x.ptr<float>(row);
+            float* my = map_y.ptr<float>(row);
+            uchar* seen = valid.ptr<uchar>(row);
+            uchar* level = level_map.ptr<uchar>(row);
+            for (int col = 0; col < map_x.cols; col++){
+                double u = H[0] * col + H[1] * row + H[2];
+                double v = H[3] * col + H[4] * row + H[5];
+                double w = H[6] * col + H[7] * row + H[8];
+                if (w > 1e-6){
+                    mx[col] = static_cast<float>(u / w);
+                    my[col] = static_cast<float>(v / w);
+                    bool inside = mx[col] >= 0 && my[col] >= 0 && mx[col] <= image_size.width - 1 && my[col] <= image_size.height - 1;
+                    seen[col] = inside ? 255 : 0;
+                    if (mip_levels > 0){
+                        // source pixels per BEV pixel along the longer axis of the footprint
+                        double x = u / w, y = v / w;
+                        double du_dc = (H[0] - x * H[6]) / w, dv_dc = (H[3] - y * H[6]) / w;
+                        double du_dr = (H[1] - x * H[7]) / w, dv_dr = (H[4] - y * H[7]) / w;
+                        double footprint = sqrt(max(du_dc * du_dc + dv_dc * dv_dc, du_dr * du_dr + dv_dr * dv_dr));
+                        int l = footprint > 1.0 ? static_cast<int>(floor(log2(footprint) + 0.5)) : 0;
+                        l = min(l, mip_levels);
+                        level[col] = static_cast<uchar>(l);
+                        mx[col] = static_cast<float>(ldexp(x, -l));
+                        my[col] = static_cast<float>(ldexp(y, -l));
+                    }
+                } else {
+                    mx[col] = my[col] = -1.0f;
+                }
+            }
+        }
+        convertMaps(map_x, map_y, map_xy, map_frac, CV_16SC2);
+        size_t tiles = static_cast<size_t>(tilesX()) * tilesY();
+        tile_visible.assign(tiles, 0);
+        tile_level_min.assign(tiles, 0);
+        tile_level_max.assign(tiles, 0);
+        for (int ty = 0; ty < tilesY(); ty++){
+            for (int tx = 0; tx < tilesX(); tx++){
+                Rect rect = tileRect(tx, ty);
+                size_t t = ty * tilesX() + tx;
+                tile_visible[t] = countNonZero(valid(rect)) > 0;
+                double lo, hi;
+                minMaxLoc(level_map(rect), &lo, &hi);
+                tile_level_min[t] = static_cast<uint8_t>(lo);
+                tile_level_max[t] = static_cast<uint8_t>(hi);
+            }
+        }
+    }
+    // exact inverse of a 3x3 homography (not just up to scale: the sign of the third
+    // coordinate is what tells points in front of the camera from points behind it)
+    static bool invert3x3(const double* m, double* out){
+        double c00 = m[4] * m[8] - m[5] * m[7];
+        double c01 = m[5] * m[6] - m[3] * m[8];
+        double c02 = m[3] * m[7] - m[4] * m[6];
+        double det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+        if (fabs(det) < 1e-12){
+            return false;
+        }
+        double adj[9] = {c00, m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+                         c01, m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+                         c02, m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3]};
+        double scale = 1.0 / det;
+        for (int i = 0; i < 9; i++){
+            out[i] = adj[i] * scale;
+        }
+        return true;
+    }
+    // one projection kernel for both directions: straight-line float code over SoA arrays
+    // so the compiler vectorizes it; points with depth <= 0 come out invalid instead of mirrored
+    static void projectPoints(const double* m, const float* in_x, const float* in_y, float* out_x, float* out_y,
+                              uint8_t* ok, size_t n){
+        const float m0 = static_cast<float>(m[0]), m1 = static_cast<float>(m[1]), m2 = static_cast<float>(m[2]);
+        const float m3 = static_cast<float>(m[3]), m4 = static_cast<float>(m[4]), m5 = static_cast<float>(m[5]);
+        const float m6 = static_cast<float>(m[6]), m7 = static_cast<float>(m[7]), m8 = static_cast<float>(m[8]);
+        for (size_t i = 0; i < n; i++){
+            float px = in_x[i], py = in_y[i];
+            float w = m6 * px + m7 * py + m8;
+            bool front = w > 1e-6f;
+            float inv = front ? 1.0f / w : 0.0f;
+            out_x[i] = (m0 * px + m1 * py + m2) * inv;
+            out_y[i] = (m3 * px + m4 * py + m5) * inv;
+            ok[i] = front ? 1 : 0;
+        }
+    }
+    void configureHomography(const double* bev_to_image, Size bev, Size image, uint64_t k){
+        key = k;
+        bev_size = bev;
+        image_size = image;
+        copy(bev_to_image, bev_to_image + 9, H);
+        if (!invert3x3(H, H_inv)){
+            LOG_ERROR("IPM homography is singular");
+            for (double& h : H_inv) h = 0;
+        }
+        buildMaps();
+    }
+public:
+    IPMModel() : mip_levels(0), key(0){
+        for (double& h : H) h = 0;
+        for (double& h : H_inv) h = 0;
+    }
+    // IPM() warp for an image size (heuristic, or metric when the config has a calibration);
+    // does nothing when config and size are unchanged
+    void configure(const IPMConfig& config, Size size){
+        if (config.metric){
+            configure(config.calibration, config.grid, size, config.mip_levels);
+            return;
+        }
+        int dims[2] = {size.width, size.height};
+        uint64_t k = hashBytes(dims, sizeof(dims), config.hash());
+        if (k == key && !map_xy.empty()){
+            return;
+        }
+        // BEV row y is row 2y + 0.5 of the tall canvas of ipmMatrix (the resize in IPM())
+        Mat M = ipmMatrix(size.width, size.height, config);
+        Mat M_inv;
+        invert(M, M_inv);
+        Mat scale = (Mat_<double>(3, 3) << 1, 0, 0, 0, 2, 0.5, 0, 0, 1);
+        Mat bev_to_image = M_inv * scale;
+        double h[9];
+        for (int i = 0; i < 9; i++){
+            h[i] = bev_to_image.at<double>(i / 3, i % 3);
+        }
+        // the scale of a homography is arbitrary, pick the sign that gives the BEV positive depth
+        if (h[6] * size.width / 2 + h[7] * size.height / 2 + h[8] < 0){
+            for (double& v : h) v = -v;
+        }
+        grid = BevGrid();
+        mip_levels = max(0, config.mip_levels);
+        configureHomography(h, size, size, k);
+    }
+    // identifies a calibrated warp: calibration, grid, image size and mip levels
+    static uint64_t calibrationKey(const WaymoCameraCalibration& calib, const BevGrid& bev_grid, Size size, int mip = 0){
+        int dims[5] = {calib.width, calib.height, size.width, size.height, mip};
+        uint64_t k = hashBytes(calib.intrinsic, sizeof(calib.intrinsic), bev_grid.hash());
+        k = hashBytes(calib.extrinsic, sizeof(calib.extrinsic), k);
+        return hashBytes(dims, sizeof(dims), k);
+    }
+    // true when configure(calib, ...) would keep the current maps
+    bool configuredFor(const WaymoCameraCalibration& calib, const BevGrid& bev_grid, Size size, int mip = 0) const {
+        return ready() && key == calibrationKey(calib, bev_grid, size, mip);
+    }
+    // calibrated warp onto a metric grid; does nothing when calibration, grid and image size are unchanged
+    void configure(const WaymoCameraCalibration& calib, const BevGrid& bev_grid, Size size, int mip = 0){
+        uint64_t k = calibrationKey(calib, bev_grid, size, mip);
+        if (k == key && !map_xy.empty()){
+            return;
+        }
+        grid = bev_grid;
+        mip_levels = max(0, mip);
+        double h[9];
+        groundHomography(calib, grid, size.width, size.height, h);
+        configureHomography(h, Size(grid.cols(), grid.rows()), size, k);
+        LOG_INFO("Calibrated IPM for camera " + to_string(calib.name) + ": " + grid.describe() + ", " +
+                 to_string(visibleTiles()) + "/" + to_string(tile_visible.size()) + " tiles in view");
+    }
+    bool ready() const { return !map_xy.empty(); }
+    const BevGrid& bevGrid() const { return grid; }
+    Size bevSize() const { return bev_size; }
+    const double* homography() const { return H; }
+    const double* inverseHomography() const { return H_inv; }
+    const Mat& validMask() const { return valid; }
+    // memory held by the warp maps, valid mask and level map
+    static size_t mapBytes(Size bev){
+        return static_cast<size_t>(bev.area()) * (4 + 2 + 1 + 1);
+    }
+    size_t mapBytes() const { return ready() ? mapBytes(bev_size) : 0; }
+
+    // The BEV is addressable in tile_size x tile_size tiles (edge tiles are smaller). A tile
+    // is warped by remapping the matching window of the maps, so any subset of tiles can be
+    // computed on its own. Tiles the camera doesn't see at all are never warped.
+    static constexpr int tile_size = 64;
+    int tilesX() const { return (bev_size.width + tile_size - 1) / tile_size; }
+    int tilesY() const { return (bev_size.height + tile_size - 1) / tile_size; }
+    Rect tileRect(int tx, int ty) const {
+        int x = tx * tile_size, y = ty * tile_size;
+        return Rect(x, y, min(tile_size, bev_size.width - x), min(tile_size, bev_size.height - y));
+    }
+    bool tileVisible(int tx, int ty) const { return tile_visible[ty * tilesX() + tx] != 0; }
+    int visibleTiles() const { return static_cast<int>(count(tile_visible.begin(), tile_visible.end(), 1)); }
+    int mipLevels() const { return mip_levels; }
+    // what tiles are warped from: the image, followed by its pyramid when mip levels are on
+    void sourceLevels(const Mat& image, vector<Mat>& levels) const {
+        levels.resize(1 + mip_levels);
+        levels[0] = image;
+        for (int l = 1; l <= mip_levels; l++){
+            pyrDown(levels[l - 1], levels[l]);
+        }
+    }
+    // warp one tile from sourceLevels() into its place in `bev` (bev_size, image type)
+    void warpTile(const vector<Mat>& levels, Mat& bev, int tx, int ty) const {
+        Rect rect = tileRect(tx, ty);
+        size_t t = ty * tilesX() + tx;
+        if (!tile_visible[t]){
+            bev(rect).setTo(Scalar(0, 0, 0));
+            return;
+        }
+        Mat out = bev(rect);
+        int lo = tile_level_min[t], hi = min<int>(tile_level_max[t], static_cast<int>(levels.size()) - 1);
+        if (lo >= hi){
+            remap(levels[min(lo, hi)], out, map_xy(rect), map_frac(rect), INTER_LINEAR, BORDER_CONSTANT, Scalar(0, 0, 0));
+            return;
+        }
+        // tile spans several levels: every level fills its own pixels
+        Mat sampled;
+        for (int l = lo; l <= hi; l++){
+            remap(levels[l], sampled, map_xy(rect), map_frac(rect), INTER_LINEAR, BORDER_CONSTANT, Scalar(0, 0, 0));
+            Mat mask = (level_map(rect) == l);
+            sampled.copyTo(out, mask);
+        }
+    }
+
+    // 2x2 box average of src into dst (floor(src size / 2), src type). An exact halving with
+    // INTER_AREA is OpenCV's SIMD fast path (rounded (a + b + c + d + 2) / 4 for 8-bit), so
+    // the odd last row / column is cut off first to keep the scale at exactly 2.
+    static void boxDownsample(const Mat& src, Mat& dst){
+        Size size(src.cols / 2, src.rows / 2);
+        if (size.width == 0 || size.height == 0){
+            dst.create(size, src.type());
+            return;
+        }
+        resize(src(Rect(0, 0, size.width * 2, size.height * 2)), dst, size, 0, 0, INTER_AREA);
+    }
+
+    // BEV pyramid in one pass: every tile is warped into pyramid[0] and, while it is still in
+    // cache, box-downsampled into the same tile of each lower level, so level l is the BEV at
+    // 1 / 2^l resolution (at most 6 levels, one 64 px tile is then one pixel). Returns pyramid[0].
+    Mat warpPyramid(const Mat& image, vector<Mat>& pyramid, int levels) const {
+        levels = min(max(levels, 0), 6);
+        pyramid.resize(1 + levels);
+        pyramid[0].create(bev_size, image.type());
+        for (int l = 1; l <= levels; l++){
+            pyramid[l].create(pyramid[l - 1].rows / 2, pyramid[l - 1].cols / 2, image.type());
+        }
+        try {
+            vector<Mat> source;
+            sourceLevels(image, source);
+            for (int ty = 0; ty < tilesY(); ty++){
+                for (int tx = 0; tx < tilesX(); tx++){
+                    warpTile(source, pyramid[0], tx, ty);
+                    for (int l = 1; l <= levels; l++){
+                        int side = tile_size >> l;
+                        Rect rect = Rect(tx * side, ty * side, side, side) & Rect(0, 0, pyramid[l].cols, pyramid[l].rows);
+                        if (rect.width <= 0 || rect.height <= 0){
+                            break;
+                        }
+                        Mat out = pyramid[l](rect);
+                        boxDownsample(pyramid[l - 1](Rect(rect.x * 2, rect.y * 2, rect.width * 2, rect.height * 2)), out);
+                    }
+                }
+            }
+        } catch(const exception& e){
+            LOG_ERROR("IPM pyramid failed: " + string(e.what()));
+            pyramid.clear();
+            return Mat();
+        }
+        return pyramid[0];
+    }
+
+    // warp into a caller-owned BEV, only reallocated when the size or type changes
+    void warpInto(const Mat& image, Mat& bev) const {
+        bev.create(bev_size, image.type());
+        vector<Mat> levels;
+        sourceLevels(image, levels);
+        for (int ty = 0; ty < tilesY(); ty++){
+            for (int tx = 0; tx < tilesX(); tx++){
+                warpTile(levels, bev, tx, ty);
+            }
+        }
+    }
+    Mat warp(const Mat& image) const {
+        Mat bev;
+        try {
+            warpInto(image, bev);
+        } catch(const exception& e){
+            LOG_ERROR("IPM remap failed: " + string(e.what()));
+            bev.release();
+        }
+        return bev;
+    }
+
+    // Batch point projection. Image points on or above the horizon don't hit the ground and
+    // BEV points behind the camera aren't imaged; both come back with valid = 0.
+    void imageToBev(const PointBatch& image_points, PointBatch& bev_points) const {
+        bev_points.resize(image_points.size());
+        projectPoints(H_inv, image_points.x.data(), image_points.y.data(), bev_points.x.data(), bev_points.y.data(),
+                      bev_points.valid.data(), image_points.size());
+    }
+    void bevToImage(const PointBatch& bev_points, PointBatch& image_points) const {
+        image_points.resize(bev_points.size());
+        projectPoints(H, bev_points.x.data(), bev_points.y.data(), image_points.x.data(), image_points.y.data(),
+                      image_points.valid.data(), bev_points.size());
+    }
+
+    // Image boxes (e.g. detections) to their BEV bounding boxes. The top of a box reaching
+    // above the horizon is cut where the ground is still in front of the camera (at the far
+    // limit), so its BEV box ends at a large but finite distance instead of wrapping around.
+    // Boxes whose bottom edge is beyond that limit are invalid.
+    void imageBoxesToBev(const vector<Rect2f>& boxes, vector<Rect2f>& bev_boxes, vector<uint8_t>& ok) const {
+        const size_t n = boxes.size();
+        // image -> BEV depth is linear in the image point and grows towards the bottom
+        auto depth = [&](float x, float y){ return H_inv[6] * x + H_inv[7] * y + H_inv[8]; };
+        double far_limit = 1e-3 * (fabs(H_inv[6]) * image_size.width + fabs(H_inv[7]) * image_size.height + fabs(H_inv[8]));
+        PointBatch corners, projected;
+        corners.resize(n * 4);
+        ok.assign(n, 0);
+        for (size_t i = 0; i < n; i++){
+            float x0 = boxes[i].x, x1 = boxes[i].x + boxes[i].width;
+            float y0 = boxes[i].y, y1 = boxes[i].y + boxes[i].height;
+            ok[i] = depth(x0, y1) >= far_limit && depth(x1, y1) >= far_limit && H_inv[7] > 0;
+            float xs[4] = {x0, x1, x1, x0};
+            float ys[4] = {y0, y0, y1, y1};
+            for (int k = 0; k < 4; k++){
+                double w = depth(xs[k], ys[k]);
+                if (ok[i] && w < far_limit){
+                    ys[k] = min(y1, static_cast<float>(ys[k] + (far_limit - w) / H_inv[7]));
+                }
+                corners.x[i * 4 + k] = xs[k];
+                corners.y[i * 4 + k] = ys[k];
+            }
+        }
+        imageToBev(corners, projected);
+        bev_boxes.assign(n, Rect2f());
+        for (size_t i = 0; i < n; i++){
+            if (!ok[i]){
+                continue;
+            }
+            float min_x = 1e30f, min_y = 1e30f, max_x = -1e30f, max_y = -1e30f;
+            for (int k = 0; k < 4; k++){
+                size_t j = i * 4 + k;
+                ok[i] &= projected.valid[j];
+                min_x = min(min_x, projected.x[j]);
+                max_x = max(max_x, projected.x[j]);
+                min_y = min(min_y, projected.y[j]);
+                max_y = max(max_y, projected.y[j]);
+            }
+            if (ok[i]){
+                bev_boxes[i] = Rect2f(min_x, min_y, max_x - min_x, max_y - min_y);
+            }
+        }
+    }
+};
+
+// Sparse IPM for one frame: callers ask for BEV tiles or rectangles and only the tiles under
+// them are warped, each at most once per frame, so overlapping requests (patches around
+// nearby detections) share the work. reset() starts the next frame.
+class BevTileCache {
+private:
+    const IPMModel* model;
+    vector<Mat> levels;
+    Mat bev;
+    vector<uint8_t> ready;
+    int computed;
+    int requested;
+public:
+    BevTileCache() : model(nullptr), computed(0), requested(0){}
+
+    void reset(const IPMModel& ipm_model, const Mat& frame){
+        model = &ipm_model;
+        model->sourceLevels(frame, levels);
+        bev.create(model->bevSize(), frame.type());
+        ready.assign(static_cast<size_t>(model->tilesX()) * model->tilesY(), 0);
+    }
+    // BEV pixels of `rect` (clipped to the BEV), a view into the frame's tile buffer
+    Mat warpRect(Rect rect){
+        rect = rect & Rect(0, 0, bev.cols, bev.rows);
+        if (!model || rect.width <= 0 || rect.height <= 0){
+            return Mat();
+        }
+        int tx0 = rect.x / IPMModel::tile_size, tx1 = (rect.x + rect.width - 1) / IPMModel::tile_size;
+        int ty0 = rect.y / IPMModel::tile_size, ty1 = (rect.y + rect.height - 1) / IPMModel::tile_size;
+        for (int ty = ty0; ty <= ty1; ty++){
+            for (int tx = tx0; tx <= tx1; tx++){
+                requested++;
+                uint8_t& done = ready[ty * model->tilesX() + tx];
+                if (!done){
+                    model->warpTile(levels, bev, tx, ty);
+                    done = 1;
+                    computed++;
+                }
+            }
+        }
+        return bev(rect);
+    }
+    Mat tile(int tx, int ty){
+        return model ? warpRect(model->tileRect(tx, ty)) : Mat();
+    }
+    // the whole BEV, computing whatever tiles are still missing
+    Mat full(){
+        return warpRect(Rect(0, 0, bev.cols, bev.rows));
+    }
+    // tiles warped / tiles asked for since construction
+    int tilesComputed() const { return computed; }
+    int tilesRequested() const { return requested; }
+};
+
+#endif // IPM_MODEL_H
@@ -0,0 +1,87 @@
+#ifndef LIDAR_BEV_H
+#define LIDAR_BEV_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "BevGrid.h"
+#include "WaymoLidar.h"
+using namespace cv;
+using namespace std;
+
+// Lidar occupancy on a BevGrid, cell for cell aligned with the calibrated camera BEV
+struct LidarBev {
+    Mat max_height;     // CV_32FC1, highest point in the cell (vehicle frame z, meters)
+    Mat density;        // CV_32FC1, number of points in the cell
+    int points = 0;     // points that fell inside the grid
+};
+
+// Bin points into the grid. The cell index of every point is computed first in a branch-free
+// loop over the x/y arrays that the compiler turns into SIMD code; points outside the grid
+// get -1. The scatter into the grid is the only scalar part. `cells` is scratch space.
+inline void binLidarPoints(const LidarPoints& points, const BevGrid& grid, LidarBev& bev, vector<int>& cells){
+    const int rows = grid.rows(), cols = grid.cols();
+    bev.max_height.create(rows, cols, CV_32FC1);
+    bev.max_height.setTo(Scalar(numeric_limits<float>::lowest()));
+    bev.density = Mat::zeros(rows, cols, CV_32FC1);
+    bev.points = 0;
+
+    const size_t n = points.size();
+    cells.resize(n);
+    const float inv_res = static_cast<float>(1.0 / grid.resolution);
+    const float forward_max = static_cast<float>(grid.forward_max);
+    const float lateral_max = static_cast<float>(grid.lateral_max);
+    const float rows_f = static_cast<float>(rows), cols_f = static_cast<float>(cols);
+    const float* px = points.x.data();
+    const float* py = points.y.data();
+    int* cell = cells.data();
+    for (size_t i = 0; i < n; i++){
+        float r = (forward_max - px[i]) * inv_res;
+        float c = (lateral_max - py[i]) * inv_res;
+        bool inside = (r >= 0.0f) & (r < rows_f) & (c >= 0.0f) & (c < cols_f);
+        // clamped so the conversion stays defined for far-away points
+        int index = static_cast<int>(min(max(r, 0.0f), rows_f)) * cols + static_cast<int>(min(max(c, 0.0f), cols_f));
+        cell[i] = inside ? index : -1;
+    }
+
+    float* height = bev.max_height.ptr<float>();
+    float* density = bev.density.ptr<float>();
+    const float* pz = points.z.data();
+    for (size_t i = 0; i < n; i++){
+        int index = cell[i];
+        if (index < 0){
+            continue;
+        }
+        height[index] = max(height[index], pz[i]);
+        density[index] += 1.0f;
+        bev.points++;
+    }
+}
+
+// Paint occupied cells onto a BEV image of the same grid: ground returns grey, anything
+// higher than obstacle_height from yellow to red with height
+inline void drawLidar(Mat& bev_image, const LidarBev& lidar, float obstacle_height = 0.3f){
+    if (bev_image.rows != lidar.density.rows || bev_image.cols != lidar.density.cols || bev_image.type() != CV_8UC3){
+        LOG_WARNING("Lidar overlay: BEV image does not match the lidar grid");
+        return;
+    }
+    for (int row = 0; row < bev_image.rows; row++){
+        const float* density = lidar.density.ptr<float>(row);
+        const float* height = lidar.max_height.ptr<float>(row);
+        Vec3b* out = bev_image.ptr<Vec3b>(row);
+        for (int col = 0; col < bev_image.cols; col++){
+            if (density[col] <= 0){
+                continue;
+            }
+            if (height[col] < obstacle_height){
+                out[col] = Vec3b(170, 170, 170);
+            } else {
+                int green = 255 - min(255, static_cast<int>((height[col] - obstacle_height) * 100));
+                out[col] = Vec3b(0, static_cast<uchar>(green), 255);
+            }
+        }
+    }
+}
+
+#endif // LIDAR_BEV_H
@@ -0,0 +1,310 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+// Bounded queues for handing frames between pipeline threads without a lock on the fast
+// path. Positions written by different threads live on their own cache lines so producer
+// and consumer don't false-share. Capacities are rounded up to a power of two.
+constexpr size_t queue_cache_line = 64;
+
+inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+inline size_t roundUpPow2(size_t n){
+    size_t p = 2;
+    while (p < n){
+        p <<= 1;
+    }
+    return p;
+}
+
+// Single producer / single consumer ring. Each side keeps a cached copy of the other side's
+// position and only reloads the shared atomic when the cache says full / empty, so a
+// handoff usually touches one shared cache line.
+template<typename T>
+class SpscRing {
+private:
+    vector<T> slots;
+    size_t mask;
+    alignas(queue_cache_line) atomic<size_t> head;  // next slot to pop (consumer)
+    size_t tail_cache;                              // consumer's view of tail
+    alignas(queue_cache_line) atomic<size_t> tail;  // next slot to push (producer)
+    size_t head_cache;                              // producer's view of head
+public:
+    explicit SpscRing(size_t capacity)
+        : slots(roundUpPow2(capacity)), mask(slots.size() - 1), head(0), tail_cache(0), tail(0), head_cache(0){}
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // moves from value only when there was room
+    bool tryPush(T&& value){
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head_cache > mask){
+            head_cache = head.load(memory_order_acquire);
+            if (t - head_cache > mask){
+                return false;
+            }
+        }
+        slots[t & mask] = move(value);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+    bool tryPop(T& out){
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail_cache){
+            tail_cache = tail.load(memory_order_acquire);
+            if (h == tail_cache){
+                return false;
+            }
+        }
+        out = move(slots[h & mask]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+    size_t sizeApprox() const {
+        // head first: it can only have moved towards the tail read after it
+        size_t h = head.load(memory_order_acquire);
+        return tail.load(memory_order_acquire) - h;
+    }
+    size_t capacity() const { return mask + 1; }
+};
+
+// Bounded multi producer / multi consumer queue (Vyukov): every cell carries a sequence
+// number that says whether it is free for the push or filled for the pop at a position, so
+// producers and consumers only contend on a CAS of their own position counter.
+template<typename T>
+class MpmcQueue {
+private:
+    struct alignas(queue_cache_line) Cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(queue_cache_line) atomic<size_t> enqueue_pos;
+    alignas(queue_cache_line) atomic<size_t> dequeue_pos;
+public:
+    explicit MpmcQueue(size_t capacity) : mask(roundUpPow2(capacity) - 1), enqueue_pos(0), dequeue_pos(0){
+        cells.reset(new Cell[mask + 1]);
+        for (size_t i = 0; i <= mask; i++){
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool tryPush(T&& value){
+        size_t pos = enqueue_pos.load(memory_order_relaxed);
+        Cell* cell;
+        while (true){
+            cell = &cells[pos & mask];
+            intptr_t diff = static_cast<intptr_t>(cell->sequence.load(memory_order_acquire)) - static_cast<intptr_t>(pos);
+            if (diff == 0){
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                    break;
+                }
+            } else if (diff < 0){
+                return false;   // full
+            } else {
+                pos = enqueue_pos.load(memory_order_relaxed);
+            }
+        }
+        cell->data = move(value);
+        cell->sequence.store(pos + 1, memory_order_release);
+        return true;
+    }
+    bool tryPop(T& out){
+        size_t pos = dequeue_pos.load(memory_order_relaxed);
+        Cell* cell;
+        while (true){
+            cell = &cells[pos & mask];
+            intptr_t diff = static_cast<intptr_t>(cell->sequence.load(memory_order_acquire)) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0){
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                    break;
+                }
+            } else if (diff < 0){
+                return false;   // empty
+            } else {
+                pos = dequeue_pos.load(memory_order_relaxed);
+            }
+        }
+        out = move(cell->data);
+        cell->sequence.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+    size_t sizeApprox() const {
+        size_t d = dequeue_pos.load(memory_order_acquire);
+        size_t e = enqueue_pos.load(memory_order_acquire);
+        return e > d ? e - d : 0;
+    }
+    size_t capacity() const { return mask + 1; }
+};
+
+// How a thread waits on an empty / full queue:
+//   Block  - sleep on a condition variable right away (no CPU burnt, ~10us+ wakeup)
+//   Spin   - busy-poll with pause (lowest latency, owns a core)
+//   Hybrid - spin briefly, then yield, then block
+enum class WaitStrategy { Block, Spin, Hybrid };
+
+inline bool waitStrategyByName(const string& name, WaitStrategy& strategy){
+    if (name == "block"){
+        strategy = WaitStrategy::Block;
+    } else if (name == "spin"){
+        strategy = WaitStrategy::Spin;
+    } else if (name == "hybrid"){
+        strategy = WaitStrategy::Hybrid;
+    } else {
+        return false;
+    }
+    return true;
+}
+inline const char* waitStrategyName(WaitStrategy strategy){
+    switch (strategy){
+        case WaitStrategy::Block: return "block";
+        case WaitStrategy::Spin: return "spin";
+        default: return "hybrid";
+    }
+}
+
+// Parks threads until a condition holds. notify() costs one atomic load when nobody sleeps,
+// the mutex is only taken to wake a sleeper.
+class QueueWaiter {
+private:
+    WaitStrategy strategy;
+    mutex mtx;
+    condition_variable cv;
+    atomic<int> sleepers;
+
+    template<typename Ready>
+    void block(Ready& ready){
+        sleepers.fetch_add(1);
+        // pairs with the fence in notify(): either the waker sees the sleeper or the
+        // sleeper sees the waker's update
+        atomic_thread_fence(memory_order_seq_cst);
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, ready);
+        }
+        sleepers.fetch_sub(1);
+    }
+public:
+    explicit QueueWaiter(WaitStrategy strategy = WaitStrategy::Hybrid) : strategy(strategy), sleepers(0){}
+
+    template<typename Ready>
+    void wait(Ready ready){
+        if (strategy == WaitStrategy::Spin){
+            while (!ready()){
+                cpuRelax();
+            }
+            return;
+        }
+        if (strategy == WaitStrategy::Hybrid){
+            // on a single core the other side can't make progress while we spin
+            static const int spins = thread::hardware_concurrency() > 1 ? 2000 : 0;
+            for (int i = 0; i < spins; i++){
+                if (ready()){
+                    return;
+                }
+                cpuRelax();
+            }
+            for (int i = 0; i < 50; i++){
+                if (ready()){
+                    return;
+                }
+                this_thread::yield();
+            }
+        }
+        block(ready);
+    }
+    void notify(){
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleepers.load(memory_order_relaxed) > 0){
+            lock_guard<mutex> lock(mtx);
+            cv.notify_all();
+        }
+    }
+    // wake everyone regardless (close)
+    void notifyAll(){
+        lock_guard<mutex> lock(mtx);
+        cv.notify_all();
+    }
+};
+
+// Blocking handoff on top of SpscRing / MpmcQueue with a wait strategy per side, e.g. a
+// spinning consumer for a latency-critical stage and a blocking producer for a slow source.
+// close() wakes everyone: push() then fails and pop() drains what is left, then fails.
+template<typename T, template<typename> class Ring = MpmcQueue>
+class HandoffQueue {
+private:
+    Ring<T> ring;
+    QueueWaiter not_empty;
+    QueueWaiter not_full;
+    atomic<bool> closed;
+public:
+    explicit HandoffQueue(size_t capacity, WaitStrategy consumer_wait = WaitStrategy::Hybrid,
+                          WaitStrategy producer_wait = WaitStrategy::Hybrid)
+        : ring(capacity), not_empty(consumer_wait), not_full(producer_wait), closed(false){}
+
+    bool push(T value){
+        while (!ring.tryPush(move(value))){
+            if (closed.load(memory_order_acquire)){
+                return false;
+            }
+            not_full.wait([&]{ return closed.load(memory_order_acquire) || ring.sizeApprox() < ring.capacity(); });
+        }
+        not_empty.notify();
+        return true;
+    }
+    bool tryPush(T value){
+        if (!ring.tryPush(move(value))){
+            return false;
+        }
+        not_empty.notify();
+        return true;
+    }
+    bool pop(T& out){
+        while (!ring.tryPop(out)){
+            if (closed.load(memory_order_acquire) && ring.sizeApprox() == 0){
+                return false;
+            }
+            not_empty.wait([&]{ return closed.load(memory_order_acquire) || ring.sizeApprox() > 0; });
+        }
+        not_full.notify();
+        return true;
+    }
+    bool tryPop(T& out){
+        if (!ring.tryPop(out)){
+            return false;
+        }
+        not_full.notify();
+        return true;
+    }
+    void close(){
+        closed.store(true, memory_order_release);
+        not_empty.notifyAll();
+        not_full.notifyAll();
+    }
+    bool isClosed() const { return closed.load(memory_order_acquire); }
+    size_t sizeApprox() const { return ring.sizeApprox(); }
+    size_t capacity() const { return ring.capacity(); }
+};
+
+#endif // LOCK_FREE_QUEUE_H
@@ -18,7 +18,7 @@ enum LogLevel { DEBUG, INFO, WARNING, ERROR_, CRITICAL};
 class Logger {
 public:
     // constructor: opens the log file in append mode
-    Logger(const string& filename) : logFilename(filename){
+    Logger(const string& filename) : logFilename(filename), console(&cout){
         logFile.open(filename, ios::app);
         if (!logFile.is_open()){
             cerr << "Error opening log file: " << filename << endl;
@@ -47,7 +47,7 @@ public:
                 << levelToString(level) << ": " << message << endl;
         
         // Output to console
-        cout << logEntry.str();
+        *console << logEntry.str();
         // Ouput to logFile
         if (logFile.is_open()){
             logFile << logEntry.str();
@@ -87,6 +87,11 @@ public:
         memMsg << "MEM | " << context << ": " << fixed << setprecision(2) << mb << "MB";
         log(INFO, memMsg.str());
     }
+    // console output to stderr, e.g. when stdout carries frames
+    void consoleToStderr(){
+        lock_guard<mutex> lock(logMutex);
+        console = &cerr;
+    }
     void logFrameRate(double fps){
         ostringstream fpsMsg;
         fpsMsg << "FPS | Current frame rate: " << fixed << setprecision(1) << fps << " fps";
@@ -95,6 +100,7 @@ public:
 private:
     string logFilename;
     ofstream logFile;
+    ostream* console;
     mutex logMutex;
     mutex timerMutex;
     map<string, high_resolution_clock::time_point> timers;
@@ -0,0 +1,137 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Logger.h"
+using namespace std;
+
+// Process-wide cap on the memory held by frames in flight. Stages that queue frames
+// (decoded records waiting for the consumer, output frames waiting for the encoders)
+// acquire() the bytes before queuing and wait while the budget is used up, which pushes
+// back all the way to the source instead of letting a slow sink grow the queues. Fixed
+// allocations (warp maps, the read-ahead window, the frames a graph keeps in flight) are
+// reserve()d: counted, never waited on.
+// A stage that holds nothing is always admitted, so a stage can't be starved by frames that
+// only it would consume further downstream, and one oversized frame can't deadlock the
+// pipeline. A limit of 0 only accounts.
+class MemoryBudget {
+private:
+    size_t limit;
+    size_t fixed_bytes;
+    size_t frame_bytes;     // acquired and not yet released
+    map<string, size_t> held;           // frame_bytes per stage
+    size_t peak;
+    mutable mutex mtx;
+    condition_variable freed;
+    map<string, size_t> reservations;
+    map<string, double> stall_ms;       // per stage, time spent waiting for memory
+    map<string, int> stalls;
+
+public:
+    explicit MemoryBudget(size_t limit = 0) : limit(limit), fixed_bytes(0), frame_bytes(0), peak(0){}
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    bool limited() const { return limit > 0; }
+    size_t limitBytes() const { return limit; }
+    size_t fixed() const {
+        lock_guard<mutex> lock(mtx);
+        return fixed_bytes;
+    }
+    // false when the reservations alone use up the budget (queued frames then only get in
+    // one at a time per stage)
+    bool fixedFits() const {
+        lock_guard<mutex> lock(mtx);
+        return !limited() || fixed_bytes <= limit;
+    }
+
+    // set the fixed allocation of a named user (replaces its previous reservation)
+    void reserve(const string& name, size_t bytes){
+        lock_guard<mutex> lock(mtx);
+        size_t& current = reservations[name];
+        fixed_bytes = fixed_bytes - current + bytes;
+        current = bytes;
+        peak = max(peak, fixed_bytes + frame_bytes);
+    }
+    // Take bytes for a queued frame of `stage`, waiting while the budget is exhausted.
+    // urgent() (called without the budget lock held) lets a waiting stage through anyway,
+    // e.g. when the consumer is blocked on exactly this frame.
+    void acquire(size_t bytes, const string& stage, const function<bool()>& urgent = nullptr){
+        unique_lock<mutex> lock(mtx);
+        size_t& stage_bytes = held[stage];
+        auto fits = [&]{ return !limited() || stage_bytes == 0 || fixed_bytes + frame_bytes + bytes <= limit; };
+        if (!fits()){
+            auto start = chrono::steady_clock::now();
+            if (urgent){
+                while (!fits()){
+                    lock.unlock();
+                    bool pass = urgent();
+                    lock.lock();
+                    if (pass){
+                        break;
+                    }
+                    freed.wait_for(lock, chrono::milliseconds(2));
+                }
+            } else {
+                freed.wait(lock, fits);
+            }
+            stall_ms[stage] += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            stalls[stage]++;
+        }
+        stage_bytes += bytes;
+        frame_bytes += bytes;
+        peak = max(peak, fixed_bytes + frame_bytes);
+    }
+    void release(size_t bytes, const string& stage){
+        lock_guard<mutex> lock(mtx);
+        size_t& stage_bytes = held[stage];
+        bytes = min(bytes, stage_bytes);
+        stage_bytes -= bytes;
+        frame_bytes -= bytes;
+        freed.notify_all();
+    }
+    size_t used() const {
+        lock_guard<mutex> lock(mtx);
+        return fixed_bytes + frame_bytes;
+    }
+    void logSummary() const {
+        lock_guard<mutex> lock(mtx);
+        LOG_INFO("Memory: peak " + to_string(peak >> 20) + " MB" + (limited() ? " of " + to_string(limit >> 20) + " MB budget" : "") +
+                 ", fixed " + to_string(fixed_bytes >> 20) + " MB");
+        for (const auto& stage : stall_ms){
+            LOG_INFO("  " + stage.first + " waited for memory " + to_string(stalls.at(stage.first)) + " times, " +
+                     to_string(static_cast<int>(stage.second)) + "ms");
+        }
+    }
+};
+
+// Bytes held from a MemoryBudget for as long as the lease lives. Shared between the queue
+// entries of one frame (e.g. every sink that got it), released by the last one.
+class MemoryLease {
+private:
+    MemoryBudget* budget;
+    size_t bytes;
+    string stage;
+public:
+    MemoryLease(MemoryBudget* budget, size_t bytes, const string& stage) : budget(budget), bytes(bytes), stage(stage){
+        if (budget){
+            budget->acquire(bytes, stage);
+        }
+    }
+    ~MemoryLease(){
+        if (budget){
+            budget->release(bytes, stage);
+        }
+    }
+    MemoryLease(const MemoryLease&) = delete;
+    MemoryLease& operator=(const MemoryLease&) = delete;
+};
+
+#endif // MEMORY_BUDGET_H
@@ -0,0 +1,76 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+
+// Cheap change detector that sits in front of IPM.
+// Every frame is reduced to a tiny grayscale thumbnail and compared with the thumbnail of
+// the last frame that was actually warped. While the mean absolute difference stays under
+// the threshold the caller reuses the previous BEV instead of warping again, which is the
+// common case when the car is stopped at a light. max_stale bounds how many frames in a row
+// can be reused so slow changes (lighting, pedestrians) still show up.
+class MotionGate {
+private:
+    double threshold;
+    int max_stale;
+    Size thumb_size;
+    Mat key_thumb;      // thumbnail of the last warped frame
+    int stale_count;
+    int reused_frames;
+    int warped_frames;
+public:
+    MotionGate(double threshold = 0.0, int max_stale = 15, Size thumb_size = Size(64, 40))
+        : threshold(threshold), max_stale(max_stale), thumb_size(thumb_size),
+          stale_count(0), reused_frames(0), warped_frames(0){}
+
+    bool enabled() const { return threshold > 0.0; }
+
+    // returns true if the previous BEV can be reused for this frame
+    bool reuse(const Mat& frame){
+        if (!enabled() || frame.empty()){
+            return false;
+        }
+        Mat small, gray;
+        // INTER_AREA averages whole blocks, so sensor noise mostly cancels out
+        resize(frame, small, thumb_size, 0, 0, INTER_AREA);
+        if (small.channels() == 3){
+            cvtColor(small, gray, COLOR_BGR2GRAY);
+        } else {
+            gray = small;
+        }
+        if (!key_thumb.empty() && stale_count < max_stale){
+            Mat diff;
+            absdiff(gray, key_thumb, diff);
+            if (mean(diff)[0] < threshold){
+                stale_count++;
+                reused_frames++;
+                return true;
+            }
+        }
+        key_thumb = gray;
+        stale_count = 0;
+        warped_frames++;
+        return false;
+    }
+    // forget the key frame, e.g. after the warp for it failed
+    void invalidate(){
+        key_thumb.release();
+    }
+
+    void logSummary(const string& name){
+        if (!enabled() || reused_frames + warped_frames == 0){
+            return;
+        }
+        double pct = (reused_frames * 100.0) / (reused_frames + warped_frames);
+        ostringstream msg;
+        msg << "Motion gate [" << name << "]: reused BEV for " << reused_frames << " of "
+            << (reused_frames + warped_frames) << " frames (" << fixed << setprecision(1) << pct << "%)";
+        LOG_INFO(msg.str());
+    }
+};
+
+#endif // MOTION_GATE_H
@@ -0,0 +1,128 @@
+#ifndef PREVIEW_WINDOW_H
+#define PREVIEW_WINDOW_H
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+
+// HighGUI preview on its own thread. The processing loop hands over at most `rate_hz`
+// frames a second with show(), which copies the frame into a spare buffer and swaps it in
+// without waiting for the window; frames in between are skipped before any copy is made.
+// The display thread owns the window (imshow / waitKey / destroyWindow only run there) and
+// redraws at the same rate, so a slow window system never holds up processing.
+// Pressing 'q' in the window sets cancelled(), which the loops poll to stop.
+// rate_hz <= 0 opens no window and show() does nothing (headless runs).
+// Note: HighGUI backends that need the main thread (Cocoa) are not supported.
+class PreviewWindow {
+private:
+    using Clock = chrono::steady_clock;
+    string name;
+    double rate_hz;
+    Clock::duration period;
+    // producer side: only the processing loop touches these
+    Mat spare;
+    Clock::time_point last_handoff;
+    bool handed_off;
+    // shared with the display thread
+    mutex mtx;
+    condition_variable cv;
+    Mat pending;
+    bool fresh;
+    bool stopping;
+    atomic<bool> cancel;
+    atomic<long long> shown;
+    long long offered;
+    thread worker;
+
+    void run(){
+        Mat frame;
+        bool window = false;
+        int wait_ms = max(1, static_cast<int>(1000.0 / rate_hz));
+        while (true){
+            bool draw = false;
+            {
+                unique_lock<mutex> lock(mtx);
+                // until the first frame there is no window to pump
+                if (!window){
+                    cv.wait(lock, [&]{ return fresh || stopping; });
+                }
+                if (stopping){
+                    break;
+                }
+                if (fresh){
+                    swap(frame, pending);
+                    fresh = false;
+                    draw = true;
+                }
+            }
+            if (draw){
+                imshow(name, frame);
+                window = true;
+                shown++;
+            }
+            // pumps the window events and paces the redraws
+            if (waitKey(wait_ms) == 'q' && !cancel){
+                LOG_INFO("Processing interrupted");
+                cancel = true;
+            }
+        }
+        if (window){
+            destroyWindow(name);
+            waitKey(1);
+        }
+    }
+public:
+    PreviewWindow(const string& name, double rate_hz)
+        : name(name), rate_hz(rate_hz), handed_off(false), fresh(false), stopping(false), cancel(false), shown(0), offered(0){
+        period = rate_hz > 0 ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / rate_hz)) : Clock::duration::zero();
+        if (rate_hz > 0){
+            worker = thread(&PreviewWindow::run, this);
+        }
+    }
+    ~PreviewWindow(){ close(); }
+    PreviewWindow(const PreviewWindow&) = delete;
+    PreviewWindow& operator=(const PreviewWindow&) = delete;
+
+    // never blocks on the window; the frame is copied only when it will be shown
+    void show(const Mat& frame){
+        offered++;
+        if (!worker.joinable() || frame.empty()){
+            return;
+        }
+        auto now = Clock::now();
+        if (handed_off && now - last_handoff < period){
+            return;
+        }
+        last_handoff = now;
+        handed_off = true;
+        frame.copyTo(spare);
+        lock_guard<mutex> lock(mtx);
+        swap(spare, pending);
+        fresh = true;
+        cv.notify_all();
+    }
+    // 'q' was pressed in the window
+    bool cancelled() const { return cancel; }
+    void close(){
+        if (!worker.joinable()){
+            return;
+        }
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+            cv.notify_all();
+        }
+        worker.join();
+        LOG_INFO("Preview " + name + ": " + to_string(shown.load()) + " of " + to_string(offered) + " frames shown at up to " +
+                 to_string(rate_hz) + " Hz");
+    }
+};
+
+#endif // PREVIEW_WINDOW_H
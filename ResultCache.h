@@ -0,0 +1,208 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+namespace fs = std::filesystem;
+
+// 64-bit content hash (xxhash64-style rounds over 4 independent lanes).
+// Not cryptographic, but fast enough to hash every input frame (several GB/s).
+inline uint64_t hashRotl(uint64_t x, int r){ return (x << r) | (x >> (64 - r)); }
+inline uint64_t hashMix(uint64_t x){
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+inline uint64_t hashBytes(const void* data, size_t len, uint64_t seed = 0){
+    const uint64_t P1 = 0x9e3779b185ebca87ULL;
+    const uint64_t P2 = 0xc2b2ae3d27d4eb4fULL;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32){
+        for (int k = 0; k < 4; k++){
+            uint64_t w;
+            memcpy(&w, p + i + 8 * k, 8);
+            lanes[k] = hashRotl(lanes[k] + w * P2, 31) * P1;
+        }
+    }
+    uint64_t h = len * P1;
+    for (int k = 0; k < 4; k++){
+        h = hashMix(h ^ lanes[k]) * P2;
+    }
+    for (; i < len; i++){
+        h = hashRotl(h ^ (p[i] * P1), 11) * P2;
+    }
+    return hashMix(h);
+}
+// Hash of the pixel content of a Mat (handles non-continuous ROIs row by row)
+inline uint64_t hashMat(const Mat& image){
+    uint64_t h = hashMix((uint64_t(image.rows) << 40) ^ (uint64_t(image.cols) << 8) ^ uint64_t(image.type()));
+    if (image.isContinuous()){
+        return hashBytes(image.data, image.total() * image.elemSize(), h);
+    }
+    for (int r = 0; r < image.rows; r++){
+        h = hashBytes(image.ptr(r), image.cols * image.elemSize(), h);
+    }
+    return h;
+}
+
+// Cache key: (input frame content hash, IPM config hash, output geometry).
+// Each component is kept separately in the file name so changing the IPM config only
+// misses for that config, entries for other configs stay valid.
+struct CacheKey {
+    uint64_t content_hash = 0;
+    uint64_t config_hash = 0;
+    Size geometry;      // processing size, 0x0 = source resolution
+};
+
+// Content-addressed on-disk store for BEV frames.
+// Layout: <dir>/<first 2 hex of content hash>/<content>_<config>_<w>x<h>.png
+// Frames are stored as lossless PNG with fast compression, writes go through a temp
+// file + rename so a killed run never leaves a truncated entry behind. load() / store() may
+// be called from several pipeline workers at once.
+// A hit reads and decodes a whole PNG, which can take longer than the warp it replaces. The
+// first hits and warps are timed (recordWarp()) so callers can compare the two.
+class ResultCache {
+private:
+    static constexpr size_t timing_samples = 16;
+    string cache_dir;
+    atomic<int> hits;
+    atomic<int> misses;
+    atomic<int> write_failures;
+    mutable mutex timing_mtx;
+    vector<double> hit_ms;
+    vector<double> warp_ms;
+
+    static double median(vector<double> samples){
+        nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    string pathFor(const CacheKey& key) const {
+        char name[80];
+        snprintf(name, sizeof(name), "%016llx_%016llx_%dx%d.png",
+                 (unsigned long long)key.content_hash, (unsigned long long)key.config_hash,
+                 key.geometry.width, key.geometry.height);
+        return (fs::path(cache_dir) / string(name, 2) / name).string();
+    }
+public:
+    ResultCache(const string& dir = "") : cache_dir(dir), hits(0), misses(0), write_failures(0){
+        if (!cache_dir.empty()){
+            error_code ec;
+            fs::create_directories(cache_dir, ec);
+            if (ec){
+                LOG_ERROR("Result cache disabled, cannot create " + cache_dir + ": " + ec.message());
+                cache_dir.clear();
+            } else {
+                LOG_INFO("Result cache: " + cache_dir);
+            }
+        }
+    }
+    bool enabled() const { return !cache_dir.empty(); }
+
+    // returns true and fills bev on a hit
+    bool load(const CacheKey& key, Mat& bev){
+        if (!enabled()){
+            return false;
+        }
+        string path = pathFor(key);
+        if (fs::exists(path)){
+            auto start = chrono::steady_clock::now();
+            bev = imread(path, IMREAD_UNCHANGED);
+            if (!bev.empty()){
+                hits++;
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                lock_guard<mutex> lock(timing_mtx);
+                if (hit_ms.size() < timing_samples){
+                    hit_ms.push_back(ms);
+                }
+                return true;
+            }
+            LOG_WARNING("Corrupt cache entry, recomputing: " + path);
+        }
+        misses++;
+        return false;
+    }
+    void store(const CacheKey& key, const Mat& bev){
+        if (!enabled() || bev.empty()){
+            return;
+        }
+        string path = pathFor(key);
+        try {
+            vector<uchar> encoded;
+            if (!imencode(".png", bev, encoded, {IMWRITE_PNG_COMPRESSION, 1})){
+                write_failures++;
+                return;
+            }
+            fs::create_directories(fs::path(path).parent_path());
+            // per process and thread, two workers may store the same frame
+            string tmp_path = path + ".tmp" + to_string(getpid()) + "_" + to_string(hash<thread::id>()(this_thread::get_id()));
+            ofstream file(tmp_path, ios::binary);
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            file.close();
+            if (!file){
+                write_failures++;
+                fs::remove(tmp_path);
+                return;
+            }
+            fs::rename(tmp_path, path);
+        } catch(const exception& e){
+            write_failures++;
+            LOG_WARNING("Result cache write failed: " + string(e.what()));
+        }
+    }
+    // time of a warp the cache would have saved
+    void recordWarp(double ms){
+        lock_guard<mutex> lock(timing_mtx);
+        if (warp_ms.size() < timing_samples){
+            warp_ms.push_back(ms);
+        }
+    }
+    // until a few warps are timed there is nothing to compare hits against
+    bool needsWarpTiming() const {
+        lock_guard<mutex> lock(timing_mtx);
+        return enabled() && warp_ms.size() < 4;
+    }
+    // median hit slower than the median warp (once both have been seen a few times)
+    bool slowerThanWarp(double& hit, double& warp) const {
+        lock_guard<mutex> lock(timing_mtx);
+        if (hit_ms.size() < 4 || warp_ms.size() < 4){
+            return false;
+        }
+        hit = median(hit_ms);
+        warp = median(warp_ms);
+        return hit > warp;
+    }
+    void logSummary(){
+        if (!enabled() || hits + misses == 0){
+            return;
+        }
+        string timing;
+        {
+            lock_guard<mutex> lock(timing_mtx);
+            if (!hit_ms.empty() && !warp_ms.empty()){
+                timing = ", median hit " + to_string(median(hit_ms)) + "ms vs warp " + to_string(median(warp_ms)) + "ms";
+            }
+        }
+        LOG_INFO("Result cache: " + to_string(hits) + " hits, " + to_string(misses) + " misses" +
+                 (write_failures ? ", " + to_string(write_failures) + " failed writes" : "") + timing);
+    }
+};
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,248 @@
+#ifndef STAGE_GRAPH_H
+#define STAGE_GRAPH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Logger.h"
+#include "WorkStealingPool.h"
+using namespace std;
+
+// A run as a DAG of stages over one Task type per frame (e.g. read -> resize -> IPM ->
+// composite -> {encode, display} -> metrics). The source fills tasks on the calling thread,
+// every stage runs on a shared WorkStealingPool:
+//   - a stage may run `parallelism` frames at once (stateless work like resize / IPM),
+//   - an ordered stage runs one frame at a time in source order (encode, display, anything
+//     with state across frames); frames that arrive early wait in its reorder buffer,
+//   - a stage with several inputs runs once a frame has come through all of them.
+// Each stage keeps its own input queue. At most max_in_flight frames are between the
+// source and the last stage, which bounds every queue and pushes back on the source.
+// A stage returning false drops the frame: later stages skip it, ordered stages still see
+// its slot go by. Stages on parallel branches see the same Task at the same time and must
+// not write the same fields. Every stage is timed the same way (run time, time queued).
+// The stage queues are deques under the stage's lock rather than the HandoffQueue rings of
+// LockFreeQueue.h: taking a frame off the queue and counting it as running has to be one
+// step (or a frame could sit queued with no run scheduled for it), and ordered stages keep
+// a reorder map, so the lock is taken either way and only held for a few pointer moves.
+template<typename Task>
+class StageGraph {
+public:
+    using StageFn = function<bool(Task&)>;
+
+private:
+    using Clock = chrono::steady_clock;
+    struct Packet {
+        int index = 0;
+        Task task;
+        atomic<bool> dropped{false};
+        atomic<int> sinks_left{0};
+    };
+    struct Ready {
+        shared_ptr<Packet> packet;
+        Clock::time_point since;
+    };
+    struct Node {
+        string name;
+        StageFn fn;
+        int parallelism = 1;
+        bool ordered = false;
+        vector<int> next;
+        int inputs = 0;
+        mutex mtx;
+        deque<Ready> queue;             // unordered stages
+        map<int, Ready> reorder;        // ordered stages, by frame index
+        map<int, int> arrivals;         // fan-in: inputs seen per frame
+        int next_index = 0;
+        int running = 0;
+        // instrumentation
+        long long frames = 0;
+        long long dropped = 0;
+        double run_ms = 0;
+        double max_ms = 0;
+        double queued_ms = 0;
+    };
+    WorkStealingPool& pool;
+    vector<unique_ptr<Node>> nodes;
+    int terminals;
+    mutex flight_mtx;
+    condition_variable flight_cv;
+    int in_flight;
+    double source_ms;
+    long long frames;
+
+    static double msSince(Clock::time_point start){
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+    // hand a frame to a stage (from the source or a predecessor)
+    void deliver(int id, const shared_ptr<Packet>& packet){
+        Node& node = *nodes[id];
+        lock_guard<mutex> lock(node.mtx);
+        if (node.inputs > 1){
+            int& seen = node.arrivals[packet->index];
+            if (++seen < node.inputs){
+                return;
+            }
+            node.arrivals.erase(packet->index);
+        }
+        Ready ready{packet, Clock::now()};
+        if (node.ordered){
+            node.reorder.emplace(packet->index, ready);
+        } else {
+            node.queue.push_back(ready);
+        }
+        schedule(id);
+    }
+    // start as many runs of a stage as it allows (node lock held)
+    void schedule(int id){
+        Node& node = *nodes[id];
+        while (node.running < node.parallelism){
+            Ready ready;
+            if (node.ordered){
+                auto first = node.reorder.begin();
+                if (first == node.reorder.end() || first->first != node.next_index){
+                    return;
+                }
+                ready = first->second;
+                node.reorder.erase(first);
+                node.next_index++;
+            } else {
+                if (node.queue.empty()){
+                    return;
+                }
+                ready = node.queue.front();
+                node.queue.pop_front();
+            }
+            node.running++;
+            node.queued_ms += msSince(ready.since);
+            shared_ptr<Packet> packet = ready.packet;
+            pool.submit([this, id, packet]{ execute(id, packet); });
+        }
+    }
+    void execute(int id, const shared_ptr<Packet>& packet){
+        Node& node = *nodes[id];
+        auto start = Clock::now();
+        bool ran = !packet->dropped;
+        if (ran){
+            try {
+                if (!node.fn(packet->task)){
+                    packet->dropped = true;
+                }
+            } catch(const exception& e){
+                LOG_ERROR("Stage " + node.name + " failed on frame " + to_string(packet->index) + ": " + e.what());
+                packet->dropped = true;
+            }
+        }
+        double ms = msSince(start);
+        // copied first: once the frame is handed on, run() may return and the graph go away
+        const vector<int> next = node.next;
+        {
+            lock_guard<mutex> lock(node.mtx);
+            node.frames += ran;
+            node.dropped += ran && packet->dropped;
+            node.run_ms += ms;
+            node.max_ms = max(node.max_ms, ms);
+            node.running--;
+            schedule(id);
+        }
+        for (int to : next){
+            deliver(to, packet);
+        }
+        if (next.empty() && --packet->sinks_left == 0){
+            lock_guard<mutex> lock(flight_mtx);
+            in_flight--;
+            flight_cv.notify_all();
+        }
+    }
+public:
+    explicit StageGraph(WorkStealingPool& pool) : pool(pool), terminals(0), in_flight(0), source_ms(0), frames(0){}
+    StageGraph(const StageGraph&) = delete;
+    StageGraph& operator=(const StageGraph&) = delete;
+
+    // returns the stage id for connect()
+    int addStage(const string& name, StageFn fn, int parallelism = 1, bool ordered = false){
+        unique_ptr<Node> node(new Node());
+        node->name = name;
+        node->fn = fn;
+        node->ordered = ordered;
+        node->parallelism = ordered ? 1 : max(1, parallelism);
+        nodes.push_back(move(node));
+        return static_cast<int>(nodes.size()) - 1;
+    }
+    void connect(int from, int to){
+        nodes[from]->next.push_back(to);
+        nodes[to]->inputs++;
+    }
+
+    // Pull tasks from source (on this thread) until it returns false and wait for the graph
+    // to drain. idle() runs on this thread between frames and while waiting, for work that
+    // has to stay on the main thread (HighGUI); returning false stops the source.
+    void run(function<bool(Task&)> source, int max_in_flight, function<bool()> idle = nullptr){
+        terminals = static_cast<int>(count_if(nodes.begin(), nodes.end(), [](const unique_ptr<Node>& n){ return n->next.empty(); }));
+        max_in_flight = max(1, max_in_flight);
+        bool stop = false;
+        for (int index = 0; !stop; index++){
+            {
+                unique_lock<mutex> lock(flight_mtx);
+                while (in_flight >= max_in_flight && !stop){
+                    lock.unlock();
+                    stop = idle && !idle();
+                    lock.lock();
+                    flight_cv.wait_for(lock, chrono::milliseconds(5), [&]{ return in_flight < max_in_flight; });
+                }
+            }
+            if (stop){
+                break;
+            }
+            shared_ptr<Packet> packet = make_shared<Packet>();
+            packet->index = index;
+            auto start = Clock::now();
+            if (!source(packet->task)){
+                break;
+            }
+            source_ms += msSince(start);
+            frames++;
+            packet->sinks_left = terminals;
+            {
+                lock_guard<mutex> lock(flight_mtx);
+                in_flight++;
+            }
+            for (size_t id = 0; id < nodes.size(); id++){
+                if (nodes[id]->inputs == 0){
+                    deliver(static_cast<int>(id), packet);
+                }
+            }
+            stop = idle && !idle();
+        }
+        unique_lock<mutex> lock(flight_mtx);
+        while (in_flight > 0){
+            lock.unlock();
+            if (idle){
+                idle();
+            }
+            lock.lock();
+            flight_cv.wait_for(lock, chrono::milliseconds(5), [&]{ return in_flight == 0; });
+        }
+    }
+
+    void logSummary(const string& title) const {
+        LOG_INFO("=== " + title + " stages (" + to_string(pool.threads()) + " threads, " + to_string(pool.stealCount()) + " steals) ===");
+        LOG_INFO("  source: " + to_string(frames) + " frames, avg " + to_string(frames ? source_ms / frames : 0.0) + "ms");
+        for (const auto& node : nodes){
+            double n = node->frames > 0 ? static_cast<double>(node->frames) : 1.0;
+            LOG_INFO("  " + node->name + (node->ordered ? " (ordered)" : " (x" + to_string(node->parallelism) + ")") + ": " +
+                     to_string(node->frames) + " frames, avg " + to_string(node->run_ms / n) + "ms, max " + to_string(node->max_ms) +
+                     "ms, queued avg " + to_string(node->queued_ms / n) + "ms" +
+                     (node->dropped ? ", " + to_string(node->dropped) + " dropped" : ""));
+        }
+    }
+};
+
+#endif // STAGE_GRAPH_H
@@ -0,0 +1,171 @@
+#ifndef STATIC_PIPELINE_H
+#define STATIC_PIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <string>
+#include "Logger.h"
+#include "IPMModel.h"
+using namespace cv;
+using namespace std;
+
+// Frame loop for a configuration that is fixed at compile time: one camera, 8UC3 frames,
+// bilinear heuristic IPM, PIP layout, one MP4. The stages are template policies, so the
+// loop has no virtual calls, std::function or per-frame option checks and the compiler can
+// inline across stages; buffers are allocated on the first frame and reused. Everything
+// else (metric grids, caches, motion gate, extra sinks, parallel stages) goes through the
+// general path in main.cpp / StageGraph.h.
+//
+// Policy interfaces:
+//   Source:     bool read(Mat& frame)
+//   Warper:     void warp(const Mat& frame, Mat& bev)
+//   Compositor: void compose(Mat& frame, const Mat& bev)
+//   Sink:       void write(const Mat& frame)
+
+// Frames from a video file
+class CaptureSource {
+private:
+    VideoCapture cap;
+public:
+    explicit CaptureSource(const string& path) : cap(path){}
+    bool isOpened() const { return cap.isOpened(); }
+    double fps() const { return cap.get(CAP_PROP_FPS); }
+    bool read(Mat& frame){ return cap.read(frame); }
+};
+
+// IPM() with the heuristic parameters: warpPerspective + resize fused into one remap by
+// IPMModel, the maps built once for the frame size
+class HomographyWarper {
+private:
+    IPMModel model;
+public:
+    HomographyWarper(const IPMConfig& config, Size frame_size){
+        IPMConfig heuristic = config;
+        heuristic.metric = false;
+        heuristic.mip_levels = 0;
+        model.configure(heuristic, frame_size);
+    }
+    void warp(const Mat& frame, Mat& bev){ model.warpInto(frame, bev); }
+};
+
+// pictureInPicture() with its layout as template arguments. The overlay rectangle is
+// worked out on the first frame; each frame then resizes the BEV straight into the frame
+// and draws the border around it, without the intermediate overlay and bordered copies.
+template<int Ratio = 3, int Border = 3, int XMargin = 30, int YAdjust = -100>
+class PipCompositor {
+private:
+    Size frame_size;
+    Size bev_size;
+    Rect inner;             // BEV inside the border, empty when it doesn't fit
+    Rect outer;
+    void layout(Size frame, Size bev){
+        frame_size = frame;
+        bev_size = bev;
+        int height = frame.height / Ratio;
+        int width = static_cast<int>(height * (static_cast<double>(bev.width) / bev.height));
+        outer = Rect(0, 0, width + 2 * Border, height + 2 * Border);
+        outer.x = frame.width - outer.width - XMargin;
+        outer.y = frame.height / 2 - outer.height + YAdjust;
+        inner = Rect(outer.x + Border, outer.y + Border, width, height);
+        if (outer.x < 0 || outer.y < 0 || outer.br().x > frame.width || outer.br().y > frame.height || width <= 0 || height <= 0){
+            LOG_WARNING("PIP overlay does not fit a " + to_string(frame.width) + "x" + to_string(frame.height) + " frame");
+            inner = outer = Rect();
+        }
+    }
+public:
+    void compose(Mat& frame, const Mat& bev){
+        if (frame.size() != frame_size || bev.size() != bev_size){
+            layout(frame.size(), bev.size());
+        }
+        if (inner.empty()){
+            return;
+        }
+        Mat roi = frame(inner);
+        resize(bev, roi, inner.size());
+        const Scalar white(255, 255, 255);
+        frame(Rect(outer.x, outer.y, outer.width, Border)).setTo(white);
+        frame(Rect(outer.x, inner.br().y, outer.width, Border)).setTo(white);
+        frame(Rect(outer.x, inner.y, Border, inner.height)).setTo(white);
+        frame(Rect(inner.br().x, inner.y, Border, inner.height)).setTo(white);
+    }
+};
+
+// The output MP4, written on the processing thread (frames are already at output size)
+class VideoWriterSink {
+private:
+    VideoWriter writer;
+public:
+    VideoWriterSink(const string& path, double fps, Size size)
+        : writer(path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, size){}
+    bool isOpened() const { return writer.isOpened(); }
+    void write(const Mat& frame){ writer.write(frame); }
+};
+
+// per stage totals in ms
+struct StaticPipelineStats {
+    long long frames = 0;
+    double read_ms = 0;
+    double resize_ms = 0;
+    double warp_ms = 0;
+    double compose_ms = 0;
+    double write_ms = 0;
+
+    double totalMs() const { return read_ms + resize_ms + warp_ms + compose_ms + write_ms; }
+    void log(const string& title) const {
+        double n = frames > 0 ? static_cast<double>(frames) : 1.0;
+        LOG_INFO("=== " + title + ": " + to_string(frames) + " frames, avg " + to_string(totalMs() / n) + "ms/frame ===");
+        LOG_INFO("  read " + to_string(read_ms / n) + "ms, resize " + to_string(resize_ms / n) + "ms, warp " +
+                 to_string(warp_ms / n) + "ms, compose " + to_string(compose_ms / n) + "ms, write " + to_string(write_ms / n) + "ms");
+    }
+};
+
+template<class Source, class Warper, class Compositor, class Sink>
+class Pipeline {
+private:
+    using Clock = chrono::steady_clock;
+    Source& source;
+    Warper& warper;
+    Compositor& compositor;
+    Sink& sink;
+    Size frame_size;
+    StaticPipelineStats totals;
+
+    static double msBetween(Clock::time_point a, Clock::time_point b){
+        return chrono::duration<double, milli>(b - a).count();
+    }
+public:
+    Pipeline(Source& source, Warper& warper, Compositor& compositor, Sink& sink, Size frame_size)
+        : source(source), warper(warper), compositor(compositor), sink(sink), frame_size(frame_size){}
+
+    // process up to max_frames frames (-1 = until the source ends), returns the frames done
+    long long run(long long max_frames = -1){
+        Mat input, frame, bev;
+        long long done = 0;
+        while (max_frames < 0 || done < max_frames){
+            auto t0 = Clock::now();
+            if (!source.read(input)){
+                break;
+            }
+            auto t1 = Clock::now();
+            resize(input, frame, frame_size);
+            auto t2 = Clock::now();
+            warper.warp(frame, bev);
+            auto t3 = Clock::now();
+            compositor.compose(frame, bev);
+            auto t4 = Clock::now();
+            sink.write(frame);
+            auto t5 = Clock::now();
+            totals.read_ms += msBetween(t0, t1);
+            totals.resize_ms += msBetween(t1, t2);
+            totals.warp_ms += msBetween(t2, t3);
+            totals.compose_ms += msBetween(t3, t4);
+            totals.write_ms += msBetween(t4, t5);
+            done++;
+        }
+        totals.frames += done;
+        return done;
+    }
+    const StaticPipelineStats& stats() const { return totals; }
+};
+
+#endif // STATIC_PIPELINE_H
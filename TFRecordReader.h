@@ -0,0 +1,204 @@
+#ifndef TFRECORD_READER_H
+#define TFRECORD_READER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logger.h"
+using namespace std;
+
+// Non-owning view of bytes inside a mapped file (valid while the file stays mapped)
+struct ByteView {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Read-only memory mapping of a whole file. The kernel is told the access is sequential and
+// the window ahead of the read cursor is prefetched with MADV_WILLNEED, so the page cache
+// does the readahead and nothing is copied out of it.
+class MappedFile {
+private:
+    const unsigned char* base;
+    size_t length;
+    size_t advised_until;
+    size_t dropped_until;
+
+    static size_t pageSize(){
+        static size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return page;
+    }
+public:
+    MappedFile() : base(nullptr), length(0), advised_until(0), dropped_until(0){}
+    ~MappedFile(){ close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const string& path){
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0){
+            return false;
+        }
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+        if (ok){
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = (addr != MAP_FAILED);
+            if (ok){
+                base = static_cast<const unsigned char*>(addr);
+                length = static_cast<size_t>(st.st_size);
+                madvise(const_cast<unsigned char*>(base), length, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);    // the mapping keeps the file referenced
+        return ok;
+    }
+    void close(){
+        if (base){
+            munmap(const_cast<unsigned char*>(base), length);
+        }
+        base = nullptr;
+        length = 0;
+        advised_until = 0;
+        dropped_until = 0;
+    }
+    // prefetch [offset, offset + window) once the cursor gets within half a window of the last hint
+    void adviseAhead(size_t offset, size_t window){
+        if (!base || offset + window / 2 < advised_until || advised_until >= length){
+            return;
+        }
+        size_t start = max(offset, advised_until) & ~(pageSize() - 1);
+        size_t end = min(length, offset + window);
+        if (end > start){
+            madvise(const_cast<unsigned char*>(base + start), end - start, MADV_WILLNEED);
+        }
+        advised_until = end;
+    }
+    // release pages behind the cursor, they won't be read again
+    void dropBehind(size_t offset){
+        size_t end = offset & ~(pageSize() - 1);
+        if (base && end > dropped_until){
+            madvise(const_cast<unsigned char*>(base + dropped_until), end - dropped_until, MADV_DONTNEED);
+            dropped_until = end;
+        }
+    }
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+    bool isOpen() const { return base != nullptr; }
+};
+
+// CRC32C (Castagnoli) with the TFRecord masking, used to check record headers
+inline uint32_t crc32c(const unsigned char* data, size_t len){
+    static uint32_t table[256];
+    static bool init = [](){
+        for (uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++){
+                c = (c & 1) ? (0x82f63b78u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)init;
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < len; i++){
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+inline uint32_t maskedCrc32c(const unsigned char* data, size_t len){
+    uint32_t crc = crc32c(data, len);
+    return ((crc >> 15) | (crc << 17)) + 0xa282ead8u;
+}
+
+// Sequential reader over a memory-mapped TFRecord file.
+// Record layout: uint64 length | uint32 masked crc32c(length) | data | uint32 masked crc32c(data).
+// next() returns a view straight into the mapping; skip() hops over records by their
+// headers only, so skipped payloads are never touched.
+class TFRecordReader {
+private:
+    MappedFile file;
+    string path;
+    size_t offset;
+    size_t readahead;
+    bool verify_data;
+
+    bool readHeader(uint64_t& length){
+        const size_t header = 12, footer = 4;
+        if (offset + header > file.size()){
+            return false;
+        }
+        const unsigned char* p = file.data() + offset;
+        uint32_t length_crc;
+        memcpy(&length, p, 8);
+        memcpy(&length_crc, p + 8, 4);
+        if (maskedCrc32c(p, 8) != length_crc){
+            LOG_ERROR("Corrupt TFRecord header at offset " + to_string(offset) + " in " + path);
+            return false;
+        }
+        if (length > file.size() || offset + header + length + footer > file.size()){
+            LOG_ERROR("Truncated TFRecord at offset " + to_string(offset) + " in " + path);
+            return false;
+        }
+        return true;
+    }
+public:
+    TFRecordReader(size_t readahead = 32u << 20, bool verify_data = false)
+        : offset(0), readahead(readahead), verify_data(verify_data){}
+
+    bool open(const string& file_path){
+        path = file_path;
+        offset = 0;
+        if (!file.open(file_path)){
+            LOG_ERROR("Unable to map TFRecord file: " + file_path);
+            return false;
+        }
+        file.adviseAhead(0, readahead);
+        return true;
+    }
+    // view of the next record's payload, valid until the reader is closed
+    bool next(ByteView& record){
+        uint64_t length;
+        if (!readHeader(length)){
+            return false;
+        }
+        const unsigned char* payload = file.data() + offset + 12;
+        if (verify_data){
+            uint32_t data_crc;
+            memcpy(&data_crc, payload + length, 4);
+            if (maskedCrc32c(payload, length) != data_crc){
+                LOG_ERROR("TFRecord data CRC mismatch at offset " + to_string(offset) + " in " + path);
+                return false;
+            }
+        }
+        record.data = payload;
+        record.size = length;
+        offset += 12 + length + 4;
+        file.adviseAhead(offset, readahead);
+        return true;
+    }
+    // skip up to n records, returns how many were skipped
+    int skip(int n){
+        int skipped = 0;
+        uint64_t length;
+        while (skipped < n && readHeader(length)){
+            offset += 12 + length + 4;
+            skipped++;
+        }
+        return skipped;
+    }
+    // done with everything before the cursor (the caller holds no older views)
+    void releaseConsumed(){
+        file.dropBehind(offset);
+    }
+    size_t position() const { return offset; }
+    size_t size() const { return file.size(); }
+    const string& filePath() const { return path; }
+};
+
+#endif // TFRECORD_READER_H
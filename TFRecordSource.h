@@ -0,0 +1,221 @@
+#ifndef TFRECORD_SOURCE_H
+#define TFRECORD_SOURCE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameRange.h"
+#include "MemoryBudget.h"
+#include "TFRecordReader.h"
+#include "Logger.h"
+using namespace std;
+
+// Reads many TFRecord files in parallel and interleaves their records, like tf.data's
+// interleave(cycle_length, block_length) with deterministic order:
+// cycle_length files are open at once, each read and decoded by its own thread into a small
+// queue; the consumer takes block_length records from each open file in turn. When a file
+// is exhausted the next input file takes its place in the cycle. Records of one file always
+// come out in file order.
+//
+// decode() runs on the reader threads and turns a record view into an Item (e.g. decodes
+// the JPEG); returning false drops the record. The range/stride is applied per file, skipped
+// records are hopped over by their headers.
+//
+// With a MemoryBudget, decoded items hold item_bytes(item) of it while they wait in the
+// queues; a reader whose queue is empty always gets through (the consumer may be waiting
+// on it). Time the readers spend blocked on full queues and the consumer spends waiting
+// for decoded items is kept for the summary.
+template<typename Item>
+class TFRecordSource {
+public:
+    using DecodeFn = function<bool(const ByteView& record, size_t file_index, int record_index, Item& item)>;
+    using BytesFn = function<size_t(const Item& item)>;
+
+private:
+    struct Slot {
+        mutex mtx;
+        condition_variable cv;
+        deque<pair<Item, size_t>> queue;   // item, budget bytes it holds
+        long file = -1;     // input file being read, -1 = none
+        bool eof = false;   // reader thread is done with `file`
+        thread worker;
+    };
+    vector<string> files;
+    DecodeFn decode;
+    FrameRange range;
+    double fps;
+    size_t block_length;
+    size_t queue_depth;
+    vector<unique_ptr<Slot>> slots;
+    size_t next_file;
+    size_t current;         // slot the consumer reads from
+    size_t block_count;
+    vector<size_t> finished;
+    atomic<bool> stopping;
+    MemoryBudget* budget;
+    BytesFn item_bytes;
+    atomic<long long> reader_stall_us;
+    long long consumer_wait_us;
+
+    void readerLoop(Slot* slot){
+        while (true){
+            long file_index;
+            {
+                unique_lock<mutex> lock(slot->mtx);
+                slot->cv.wait(lock, [&]{ return stopping || (slot->file >= 0 && !slot->eof); });
+                if (stopping){
+                    return;
+                }
+                file_index = slot->file;
+            }
+            TFRecordReader reader;
+            if (reader.open(files[file_index])){
+                FrameRange r = range.resolve(fps, -1);
+                int index = reader.skip(r.start);
+                ByteView record;
+                int decoded = 0;
+                while ((r.end < 0 || index < r.end) && reader.next(record)){
+                    int record_index = index;
+                    index += 1 + reader.skip(r.stride - 1);
+                    Item item;
+                    if (!decode(record, file_index, record_index, item)){
+                        continue;
+                    }
+                    size_t bytes = 0;
+                    if (budget){
+                        bytes = item_bytes(item);
+                        budget->acquire(bytes, "decode", [&]{
+                            lock_guard<mutex> lock(slot->mtx);
+                            return stopping || slot->queue.empty();
+                        });
+                    }
+                    unique_lock<mutex> lock(slot->mtx);
+                    if (!stopping && slot->queue.size() >= queue_depth){
+                        auto start = chrono::steady_clock::now();
+                        slot->cv.wait(lock, [&]{ return stopping || slot->queue.size() < queue_depth; });
+                        reader_stall_us += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+                    }
+                    if (stopping){
+                        if (budget){
+                            budget->release(bytes, "decode");
+                        }
+                        return;
+                    }
+                    slot->queue.emplace_back(move(item), bytes);
+                    slot->cv.notify_all();
+                    lock.unlock();
+                    if (++decoded % 64 == 0){
+                        reader.releaseConsumed();
+                    }
+                }
+            }
+            lock_guard<mutex> lock(slot->mtx);
+            slot->eof = true;
+            slot->cv.notify_all();
+        }
+    }
+    // hand the next input file to a slot (slot lock held)
+    bool assign(Slot& slot){
+        if (next_file >= files.size()){
+            return false;
+        }
+        slot.file = static_cast<long>(next_file++);
+        slot.eof = false;
+        slot.cv.notify_all();
+        return true;
+    }
+public:
+    TFRecordSource(const vector<string>& files, DecodeFn decode, int cycle_length = 4, int block_length = 1,
+                   const FrameRange& range = FrameRange(), double fps = 30.0, size_t queue_depth = 4,
+                   MemoryBudget* budget = nullptr, BytesFn item_bytes = nullptr)
+        : files(files), decode(decode), range(range), fps(fps), block_length(max(1, block_length)),
+          queue_depth(max(size_t(1), queue_depth)), next_file(0), current(0), block_count(0), stopping(false),
+          budget(item_bytes ? budget : nullptr), item_bytes(item_bytes), reader_stall_us(0), consumer_wait_us(0){
+        size_t cycle = min(files.size(), size_t(max(1, cycle_length)));
+        for (size_t i = 0; i < cycle; i++){
+            slots.emplace_back(new Slot());
+            assign(*slots.back());
+        }
+        for (auto& slot : slots){
+            slot->worker = thread(&TFRecordSource::readerLoop, this, slot.get());
+        }
+        LOG_INFO("TFRecord source: " + to_string(files.size()) + " files, cycle length " + to_string(cycle) +
+                 ", block length " + to_string(this->block_length));
+    }
+    ~TFRecordSource(){
+        for (auto& slot : slots){
+            lock_guard<mutex> lock(slot->mtx);
+            stopping = true;
+            slot->cv.notify_all();
+        }
+        for (auto& slot : slots){
+            slot->worker.join();
+            for (auto& queued : slot->queue){
+                if (budget){
+                    budget->release(queued.second, "decode");
+                }
+            }
+        }
+    }
+    TFRecordSource(const TFRecordSource&) = delete;
+    TFRecordSource& operator=(const TFRecordSource&) = delete;
+
+    // next record in interleaved order, false once every file is exhausted
+    bool next(Item& item, size_t& file_index){
+        size_t idle = 0;
+        while (idle < slots.size()){
+            Slot& slot = *slots[current];
+            unique_lock<mutex> lock(slot.mtx);
+            if (slot.file < 0 && !assign(slot)){
+                // nothing left to read in this position
+                idle++;
+                current = (current + 1) % slots.size();
+                block_count = 0;
+                continue;
+            }
+            idle = 0;
+            if (slot.queue.empty() && !slot.eof){
+                auto start = chrono::steady_clock::now();
+                slot.cv.wait(lock, [&]{ return !slot.queue.empty() || slot.eof; });
+                consumer_wait_us += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            }
+            if (!slot.queue.empty()){
+                item = move(slot.queue.front().first);
+                if (budget){
+                    budget->release(slot.queue.front().second, "decode");
+                }
+                slot.queue.pop_front();
+                file_index = static_cast<size_t>(slot.file);
+                slot.cv.notify_all();
+                if (++block_count >= block_length){
+                    block_count = 0;
+                    current = (current + 1) % slots.size();
+                }
+                return true;
+            }
+            // file exhausted, the next one opens in the same cycle position
+            finished.push_back(static_cast<size_t>(slot.file));
+            slot.file = -1;
+            block_count = 0;
+        }
+        return false;
+    }
+    // files that were fully consumed since the last call
+    void takeFinished(vector<size_t>& done){
+        done.swap(finished);
+        finished.clear();
+    }
+    const string& fileName(size_t file_index) const { return files[file_index]; }
+    // stall time: readers blocked on full queues / consumer waiting for decoded records
+    double readerStallMs() const { return reader_stall_us.load() / 1000.0; }
+    double consumerWaitMs() const { return consumer_wait_us / 1000.0; }
+};
+
+#endif // TFRECORD_SOURCE_H
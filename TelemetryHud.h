@@ -0,0 +1,161 @@
+#ifndef TELEMETRY_HUD_H
+#define TELEMETRY_HUD_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Logger.h"
+using namespace cv;
+using namespace std;
+
+// Printable ASCII rendered once with putText (anti-aliased) into a coverage atlas. Drawing a
+// line copies the glyph cells into a line mask and alpha-blends the mask into the frame, so
+// text costs a few memcpy's and some per-pixel arithmetic instead of a Hershey rasterization
+// per character. The coverage is stored with 3 equal channels so the blend is plain
+// element-wise arithmetic on the frame ROI, which OpenCV runs on its SIMD kernels.
+class GlyphAtlas {
+private:
+    static constexpr int first = 32;
+    static constexpr int last = 126;
+    struct Glyph {
+        int x;          // cell in the atlas
+        int width;      // advance + padding on both sides
+        int advance;
+    };
+    Mat atlas;          // 8UC3 coverage
+    Glyph glyphs[last - first + 1];
+    int pad;            // anti-aliasing reaches past the advance
+    int height;
+
+    const Glyph& glyph(char ch) const {
+        int c = static_cast<unsigned char>(ch);
+        return glyphs[(c < first || c > last ? '?' : c) - first];
+    }
+public:
+    explicit GlyphAtlas(double scale = 0.5, int thickness = 1, int font = FONT_HERSHEY_SIMPLEX){
+        int baseline = 0;
+        Size box = getTextSize("Ag|", font, scale, thickness, &baseline);
+        pad = thickness + 1;
+        height = box.height + baseline + 2 * pad;
+        int x = 0;
+        for (int c = first; c <= last; c++){
+            int advance = getTextSize(string(1, static_cast<char>(c)), font, scale, thickness, &baseline).width;
+            glyphs[c - first] = {x, advance + 2 * pad, advance};
+            x += advance + 2 * pad;
+        }
+        Mat coverage(height, x, CV_8UC1, Scalar(0));
+        for (int c = first; c <= last; c++){
+            const Glyph& g = glyphs[c - first];
+            putText(coverage, string(1, static_cast<char>(c)), Point(g.x + pad, pad + box.height), font, scale, Scalar(255), thickness, LINE_AA);
+        }
+        cvtColor(coverage, atlas, COLOR_GRAY2BGR);
+    }
+    int lineHeight() const { return height; }
+    int textWidth(const string& text) const {
+        int width = 2 * pad;
+        for (char ch : text){
+            width += glyph(ch).advance;
+        }
+        return width;
+    }
+    // coverage of one line of text into mask (lineHeight() x textWidth(), 8UC3)
+    void render(const string& text, Mat& mask) const {
+        mask.create(height, textWidth(text), CV_8UC3);
+        mask.setTo(Scalar::all(0));
+        int pen = 0;
+        for (char ch : text){
+            const Glyph& g = glyph(ch);
+            Mat cell = mask(Rect(pen, 0, g.width, height));
+            // neighbouring cells overlap in the padding
+            cv::max(cell, atlas(Rect(g.x, 0, g.width, height)), cell);
+            pen += g.advance;
+        }
+    }
+    // frame = (frame * (255 - mask) + color * mask) / 255 with the mask's top-left at origin,
+    // clipped to the frame (8UC3 frames only)
+    static void blend(Mat& frame, const Mat& mask, Point origin, const Vec3b& color){
+        Rect area = Rect(origin, mask.size()) & Rect(0, 0, frame.cols, frame.rows);
+        if (frame.type() != CV_8UC3 || area.width <= 0 || area.height <= 0){
+            return;
+        }
+        Mat out = frame(area);
+        Mat alpha = mask(Rect(area.x - origin.x, area.y - origin.y, area.width, area.height));
+        thread_local Mat inverse, tint;
+        subtract(Scalar::all(255), alpha, inverse);
+        multiply(out, inverse, out, 1.0 / 255);
+        multiply(alpha, Scalar(color[0], color[1], color[2]), tint, 1.0 / 255);
+        add(out, tint, out);
+    }
+    // halve the brightness of a rectangle (backdrop for text)
+    static void dim(Mat& frame, Rect area){
+        area = area & Rect(0, 0, frame.cols, frame.rows);
+        if (frame.type() != CV_8UC3 || area.width <= 0 || area.height <= 0){
+            return;
+        }
+        Mat out = frame(area);
+        out.convertTo(out, -1, 0.5);
+    }
+};
+
+// Telemetry in the top-left corner of the output: frame number, output fps, per-stage
+// latency and dropped frames, drawn from a GlyphAtlas on a dimmed backdrop. Cheap enough to
+// stay on in recordings; the draw time is measured and reported by logSummary().
+class TelemetryHud {
+private:
+    using Clock = chrono::steady_clock;
+    GlyphAtlas atlas;
+    Mat mask;
+    Clock::time_point last_frame;
+    double frame_ms;            // smoothed interval between frames
+    long long drawn;
+    double draw_us;
+    double max_us;
+public:
+    explicit TelemetryHud(double scale = 0.5) : atlas(scale), frame_ms(0), drawn(0), draw_us(0), max_us(0){}
+
+    // lines of text in a box at origin
+    void draw(Mat& frame, const vector<string>& lines, Point origin = Point(10, 10)){
+        const int margin = 4;
+        int width = 0;
+        for (const string& line : lines){
+            width = max(width, atlas.textWidth(line));
+        }
+        int height = static_cast<int>(lines.size()) * atlas.lineHeight();
+        GlyphAtlas::dim(frame, Rect(origin.x, origin.y, width + 2 * margin, height + 2 * margin));
+        Point pen(origin.x + margin, origin.y + margin);
+        for (const string& line : lines){
+            atlas.render(line, mask);
+            GlyphAtlas::blend(frame, mask, pen, Vec3b(255, 255, 255));
+            pen.y += atlas.lineHeight();
+        }
+    }
+    // the stats of the frame about to be written; fps is measured between calls
+    void drawStats(Mat& frame, long long frame_number, double ipm_ms, double pip_ms, double total_ms, long long dropped){
+        auto start = Clock::now();
+        if (drawn > 0){
+            double interval = chrono::duration<double, milli>(start - last_frame).count();
+            frame_ms = frame_ms > 0 ? 0.9 * frame_ms + 0.1 * interval : interval;
+        }
+        last_frame = start;
+        char text[3][64];
+        snprintf(text[0], sizeof(text[0]), "frame %lld  %.1f fps", frame_number, frame_ms > 0 ? 1000.0 / frame_ms : 0.0);
+        snprintf(text[1], sizeof(text[1]), "ipm %.1f  pip %.1f  total %.1f ms", ipm_ms, pip_ms, total_ms);
+        snprintf(text[2], sizeof(text[2]), "dropped %lld", dropped);
+        draw(frame, {text[0], text[1], text[2]});
+        double us = chrono::duration<double, micro>(Clock::now() - start).count();
+        drawn++;
+        draw_us += us;
+        max_us = max(max_us, us);
+    }
+    void logSummary() const {
+        if (drawn > 0){
+            LOG_INFO("HUD: " + to_string(drawn) + " frames, avg " + to_string(draw_us / drawn) + "us, max " + to_string(max_us) + "us");
+        }
+    }
+};
+
+#endif // TELEMETRY_HUD_H
@@ -0,0 +1,292 @@
+#ifndef WAYMO_FRAME_H
+#define WAYMO_FRAME_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TFRecordReader.h"
+using namespace std;
+
+// Waymo Open Dataset camera / laser names (dataset.proto CameraName, LaserName)
+enum WaymoCamera { WAYMO_FRONT = 1, WAYMO_FRONT_LEFT = 2, WAYMO_FRONT_RIGHT = 3, WAYMO_SIDE_LEFT = 4, WAYMO_SIDE_RIGHT = 5 };
+enum WaymoLaser { WAYMO_LASER_TOP = 1, WAYMO_LASER_FRONT = 2, WAYMO_LASER_SIDE_LEFT = 3, WAYMO_LASER_SIDE_RIGHT = 4, WAYMO_LASER_REAR = 5 };
+
+inline int waymoCameraByName(const string& name){
+    static const char* names[] = {"FRONT", "FRONT_LEFT", "FRONT_RIGHT", "SIDE_LEFT", "SIDE_RIGHT"};
+    for (int i = 0; i < 5; i++){
+        if (name == names[i]){
+            return i + 1;
+        }
+    }
+    return -1;
+}
+inline unsigned waymoCameraBit(int camera){
+    return 1u << camera;
+}
+
+// Cursor over protobuf wire format. Only what the Waymo messages use: varints, 64/32-bit
+// scalars and length-delimited fields. A length-delimited field that isn't wanted is skipped
+// by its length without looking inside it, which is what makes the frame parse cheap.
+class ProtoReader {
+private:
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok;
+public:
+    explicit ProtoReader(const ByteView& view) : p(view.data), end(view.data + view.size), ok(view.data != nullptr || view.size == 0){}
+
+    // next field tag, false at the end of the message or on malformed input
+    bool next(uint32_t& field, int& wire){
+        if (!ok || p >= end){
+            return false;
+        }
+        uint64_t tag = varint();
+        field = static_cast<uint32_t>(tag >> 3);
+        wire = static_cast<int>(tag & 7);
+        return ok && field != 0;
+    }
+    uint64_t varint(){
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7){
+            if (p >= end){
+                break;
+            }
+            unsigned char byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)){
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+    ByteView bytes(){
+        ByteView view;
+        uint64_t length = varint();
+        if (!ok || length > static_cast<uint64_t>(end - p)){
+            ok = false;
+            return view;
+        }
+        view.data = p;
+        view.size = static_cast<size_t>(length);
+        p += length;
+        return view;
+    }
+    double fixed64(){
+        double value = 0;
+        if (end - p < 8){
+            ok = false;
+            return value;
+        }
+        memcpy(&value, p, 8);
+        p += 8;
+        return value;
+    }
+    float fixed32(){
+        float value = 0;
+        if (end - p < 4){
+            ok = false;
+            return value;
+        }
+        memcpy(&value, p, 4);
+        p += 4;
+        return value;
+    }
+    // skip a field's value, returns the number of bytes skipped
+    size_t skip(int wire){
+        const unsigned char* start = p;
+        switch (wire){
+            case 0: varint(); break;
+            case 1: p = (end - p < 8) ? (ok = false, end) : p + 8; break;
+            case 2: bytes(); break;
+            case 5: p = (end - p < 4) ? (ok = false, end) : p + 4; break;
+            default: ok = false; break;     // groups are not used by the dataset
+        }
+        return static_cast<size_t>(p - start);
+    }
+    // repeated double, packed or not (dataset.proto is proto2, so usually not); returns values stored
+    int doubles(int wire, double* out, int stored, int capacity){
+        if (wire == 1){
+            double value = fixed64();
+            if (stored < capacity){
+                out[stored++] = value;
+            }
+        } else if (wire == 2){
+            ProtoReader packed(bytes());
+            while (packed.p < packed.end && packed.ok){
+                double value = packed.fixed64();
+                if (packed.ok && stored < capacity){
+                    out[stored++] = value;
+                }
+            }
+        } else {
+            skip(wire);
+        }
+        return stored;
+    }
+    // repeated float, packed or not
+    void floats(int wire, vector<float>& out){
+        if (wire == 5){
+            out.push_back(fixed32());
+        } else if (wire == 2){
+            ByteView view = bytes();
+            size_t offset = out.size();
+            out.resize(offset + view.size / 4);
+            if (view.size > 0){
+                memcpy(out.data() + offset, view.data, (view.size / 4) * 4);
+            }
+        } else {
+            skip(wire);
+        }
+    }
+    // repeated int32/int64, packed or not
+    void varints(int wire, vector<int64_t>& out){
+        if (wire == 0){
+            out.push_back(static_cast<int64_t>(varint()));
+        } else if (wire == 2){
+            ProtoReader packed(bytes());
+            while (packed.p < packed.end && packed.ok){
+                out.push_back(static_cast<int64_t>(packed.varint()));
+            }
+        } else {
+            skip(wire);
+        }
+    }
+    bool good() const { return ok; }
+};
+
+struct WaymoCameraCalibration {
+    int name = 0;
+    double intrinsic[9] = {0};      // f_u, f_v, c_u, c_v, k1, k2, p1, p2, k3
+    double extrinsic[16] = {0};     // camera -> vehicle, row-major 4x4
+    int width = 0;
+    int height = 0;
+};
+
+// The parts of a Waymo Frame the IPM pipeline uses. Images and lasers are views into the
+// record (valid while the TFRecord stays mapped); lasers and laser calibrations are only
+// collected when asked for and are left undecoded.
+struct WaymoFrame {
+    int64_t timestamp_micros = 0;
+    double pose[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};     // vehicle -> world
+    vector<pair<int, ByteView>> images;                  // camera name, encoded JPEG
+    vector<WaymoCameraCalibration> camera_calibrations;
+    vector<ByteView> lasers;                             // dataset.proto Laser messages
+    vector<ByteView> laser_calibrations;                 // dataset.proto LaserCalibration messages
+    size_t skipped_bytes = 0;                            // payload not looked at
+
+    const ByteView* image(int camera) const {
+        for (const auto& entry : images){
+            if (entry.first == camera){
+                return &entry.second;
+            }
+        }
+        return nullptr;
+    }
+    const WaymoCameraCalibration* calibration(int camera) const {
+        for (const auto& calib : camera_calibrations){
+            if (calib.name == camera){
+                return &calib;
+            }
+        }
+        return nullptr;
+    }
+};
+
+inline bool parseTransform(const ByteView& view, double* out){
+    ProtoReader r(view);
+    uint32_t field;
+    int wire;
+    int stored = 0;
+    while (r.next(field, wire)){
+        if (field == 1){
+            stored = r.doubles(wire, out, stored, 16);
+        } else {
+            r.skip(wire);
+        }
+    }
+    return r.good() && stored == 16;
+}
+
+inline bool parseCameraCalibration(const ByteView& view, WaymoCameraCalibration& calib){
+    ProtoReader r(view);
+    uint32_t field;
+    int wire;
+    int intrinsics = 0;
+    while (r.next(field, wire)){
+        switch (field){
+            case 1: calib.name = static_cast<int>(r.varint()); break;
+            case 2: intrinsics = r.doubles(wire, calib.intrinsic, intrinsics, 9); break;
+            case 3: parseTransform(r.bytes(), calib.extrinsic); break;
+            case 4: calib.width = static_cast<int>(r.varint()); break;
+            case 5: calib.height = static_cast<int>(r.varint()); break;
+            default: r.skip(wire); break;
+        }
+    }
+    return r.good();
+}
+
+// Walk a serialized Frame, keeping the pose, calibrations and the images of the cameras in
+// camera_mask (waymoCameraBit). Everything else - laser range images, labels, projected
+// lidar labels, map features - is skipped by length, so a frame costs a few hundred tag reads
+// instead of a full deserialization.
+inline bool parseWaymoFrame(const ByteView& record, WaymoFrame& frame, unsigned camera_mask = ~0u, bool want_lasers = false){
+    frame = WaymoFrame();
+    ProtoReader r(record);
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)){
+        if (field == 1 && wire == 2){
+            // Context: name=1, camera_calibrations=2, laser_calibrations=3, stats=4
+            ProtoReader context(r.bytes());
+            uint32_t context_field;
+            int context_wire;
+            while (context.next(context_field, context_wire)){
+                if (context_field == 2 && context_wire == 2){
+                    WaymoCameraCalibration calib;
+                    if (parseCameraCalibration(context.bytes(), calib)){
+                        frame.camera_calibrations.push_back(calib);
+                    }
+                } else if (context_field == 3 && context_wire == 2 && want_lasers){
+                    frame.laser_calibrations.push_back(context.bytes());
+                } else {
+                    frame.skipped_bytes += context.skip(context_wire);
+                }
+            }
+        } else if (field == 2 && wire == 0){
+            frame.timestamp_micros = static_cast<int64_t>(r.varint());
+        } else if (field == 3 && wire == 2){
+            parseTransform(r.bytes(), frame.pose);
+        } else if (field == 4 && wire == 2){
+            // CameraImage: name=1, image=2
+            ByteView camera_image = r.bytes();
+            ProtoReader image(camera_image);
+            uint32_t image_field;
+            int image_wire;
+            int name = 0;
+            ByteView jpeg;
+            while (image.next(image_field, image_wire)){
+                if (image_field == 1 && image_wire == 0){
+                    name = static_cast<int>(image.varint());
+                } else if (image_field == 2 && image_wire == 2){
+                    jpeg = image.bytes();
+                } else {
+                    image.skip(image_wire);
+                }
+            }
+            if (name > 0 && name < 32 && (camera_mask & waymoCameraBit(name)) && jpeg.size > 0){
+                frame.images.emplace_back(name, jpeg);
+            } else {
+                frame.skipped_bytes += camera_image.size;
+            }
+        } else if (field == 5 && wire == 2 && want_lasers){
+            frame.lasers.push_back(r.bytes());
+        } else {
+            frame.skipped_bytes += r.skip(wire);
+        }
+    }
+    return r.good();
+}
+
+#endif // WAYMO_FRAME_H
@@ -0,0 +1,217 @@
+#ifndef WAYMO_LIDAR_H
+#define WAYMO_LIDAR_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <zlib.h>
+#include "WaymoFrame.h"
+using namespace std;
+
+struct WaymoLaserCalibration {
+    int name = 0;
+    vector<double> beam_inclinations;   // radians, may be empty (uniform between min and max)
+    double inclination_min = 0;
+    double inclination_max = 0;
+    double extrinsic[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};    // laser -> vehicle
+};
+
+// Lidar points in the vehicle frame, stored as separate x/y/z arrays so the binning loop
+// streams through contiguous floats.
+struct LidarPoints {
+    vector<float> x, y, z;
+    void clear(){ x.clear(); y.clear(); z.clear(); }
+    size_t size() const { return x.size(); }
+};
+
+// LaserCalibration: name=1, beam_inclinations=2, beam_inclination_min=3, beam_inclination_max=4, extrinsic=5
+inline bool parseLaserCalibration(const ByteView& view, WaymoLaserCalibration& calib){
+    ProtoReader r(view);
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)){
+        switch (field){
+            case 1: calib.name = static_cast<int>(r.varint()); break;
+            case 2: {
+                double values[256];
+                int count = r.doubles(wire, values, 0, 256);
+                calib.beam_inclinations.insert(calib.beam_inclinations.end(), values, values + count);
+                break;
+            }
+            case 3: calib.inclination_min = r.fixed64(); break;
+            case 4: calib.inclination_max = r.fixed64(); break;
+            case 5: parseTransform(r.bytes(), calib.extrinsic); break;
+            default: r.skip(wire); break;
+        }
+    }
+    return r.good();
+}
+
+// Laser: name=1, ri_return1=2 -> RangeImage: range_image_compressed=2 (only the first return is used)
+inline bool parseLaser(const ByteView& view, int& name, ByteView& compressed){
+    ProtoReader r(view);
+    uint32_t field;
+    int wire;
+    name = 0;
+    compressed = ByteView();
+    while (r.next(field, wire)){
+        if (field == 1 && wire == 0){
+            name = static_cast<int>(r.varint());
+        } else if (field == 2 && wire == 2){
+            ProtoReader range_image(r.bytes());
+            uint32_t ri_field;
+            int ri_wire;
+            while (range_image.next(ri_field, ri_wire)){
+                if (ri_field == 2 && ri_wire == 2){
+                    compressed = range_image.bytes();
+                } else {
+                    range_image.skip(ri_wire);
+                }
+            }
+        } else {
+            r.skip(wire);
+        }
+    }
+    return r.good() && compressed.size > 0;
+}
+
+// zlib stream of unknown decompressed size into `out` (reused between calls)
+inline bool inflateBytes(const ByteView& in, vector<unsigned char>& out){
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK){
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(in.data);
+    stream.avail_in = static_cast<uInt>(in.size);
+    if (out.size() < in.size * 4){
+        out.resize(in.size * 4);
+    }
+    size_t produced = 0;
+    int status = Z_OK;
+    while (status == Z_OK){
+        if (produced == out.size()){
+            out.resize(out.size() * 2);
+        }
+        stream.next_out = out.data() + produced;
+        stream.avail_out = static_cast<uInt>(out.size() - produced);
+        status = inflate(&stream, Z_NO_FLUSH);
+        produced = out.size() - stream.avail_out;
+    }
+    inflateEnd(&stream);
+    out.resize(produced);
+    return status == Z_STREAM_END;
+}
+
+// Compressed range image -> MatrixFloat{data=1, shape=2{dims=1}}, shape [rows, cols, channels]
+inline bool decodeRangeImage(const ByteView& compressed, vector<unsigned char>& scratch, vector<float>& values,
+                             int& rows, int& cols, int& channels){
+    values.clear();
+    if (!inflateBytes(compressed, scratch)){
+        return false;
+    }
+    vector<int64_t> dims;
+    ProtoReader r(ByteView{scratch.data(), scratch.size()});
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)){
+        if (field == 1){
+            r.floats(wire, values);
+        } else if (field == 2 && wire == 2){
+            ProtoReader shape(r.bytes());
+            uint32_t shape_field;
+            int shape_wire;
+            while (shape.next(shape_field, shape_wire)){
+                if (shape_field == 1){
+                    shape.varints(shape_wire, dims);
+                } else {
+                    shape.skip(shape_wire);
+                }
+            }
+        } else {
+            r.skip(wire);
+        }
+    }
+    if (!r.good() || dims.size() != 3 || dims[0] * dims[1] * dims[2] != static_cast<int64_t>(values.size())){
+        return false;
+    }
+    rows = static_cast<int>(dims[0]);
+    cols = static_cast<int>(dims[1]);
+    channels = static_cast<int>(dims[2]);
+    return true;
+}
+
+// Range image (channel 0 = range) -> vehicle frame points, appended to `points`.
+// Same geometry as the dataset's range_image_utils: rows are beams from the highest
+// inclination down, columns sweep azimuth from +pi to -pi relative to the laser's heading.
+// The per-pixel pose correction of the rolling TOP lidar is not applied.
+inline void rangeImageToPoints(const vector<float>& values, int rows, int cols, int channels,
+                               const WaymoLaserCalibration& calib, LidarPoints& points){
+    vector<float> cos_incl(rows), sin_incl(rows), cos_az(cols), sin_az(cols);
+    for (int row = 0; row < rows; row++){
+        double inclination;
+        if (static_cast<int>(calib.beam_inclinations.size()) == rows){
+            inclination = calib.beam_inclinations[rows - 1 - row];
+        } else {
+            double ratio = (rows - 1 - row + 0.5) / rows;
+            inclination = calib.inclination_min + ratio * (calib.inclination_max - calib.inclination_min);
+        }
+        cos_incl[row] = static_cast<float>(cos(inclination));
+        sin_incl[row] = static_cast<float>(sin(inclination));
+    }
+    const double* E = calib.extrinsic;
+    double az_correction = atan2(E[4], E[0]);
+    for (int col = 0; col < cols; col++){
+        double ratio = (cols - col - 0.5) / cols;
+        double azimuth = (ratio * 2 - 1) * M_PI - az_correction;
+        cos_az[col] = static_cast<float>(cos(azimuth));
+        sin_az[col] = static_cast<float>(sin(azimuth));
+    }
+    float e[12];
+    for (int i = 0; i < 12; i++){
+        e[i] = static_cast<float>(E[i]);
+    }
+    for (int row = 0; row < rows; row++){
+        const float* range = values.data() + static_cast<size_t>(row) * cols * channels;
+        for (int col = 0; col < cols; col++){
+            float r = range[col * channels];
+            if (r <= 0){
+                continue;
+            }
+            float xy = r * cos_incl[row];
+            float lx = xy * cos_az[col], ly = xy * sin_az[col], lz = r * sin_incl[row];
+            points.x.push_back(e[0] * lx + e[1] * ly + e[2] * lz + e[3]);
+            points.y.push_back(e[4] * lx + e[5] * ly + e[6] * lz + e[7]);
+            points.z.push_back(e[8] * lx + e[9] * ly + e[10] * lz + e[11]);
+        }
+    }
+}
+
+// All lidar points of a frame parsed with want_lasers, returns the number of lasers decoded
+inline int waymoLidarPoints(const WaymoFrame& frame, LidarPoints& points, vector<unsigned char>& scratch){
+    vector<WaymoLaserCalibration> calibrations;
+    for (const ByteView& view : frame.laser_calibrations){
+        WaymoLaserCalibration calib;
+        if (parseLaserCalibration(view, calib)){
+            calibrations.push_back(calib);
+        }
+    }
+    int decoded = 0;
+    vector<float> values;
+    for (const ByteView& view : frame.lasers){
+        int name, rows, cols, channels;
+        ByteView compressed;
+        if (!parseLaser(view, name, compressed) || !decodeRangeImage(compressed, scratch, values, rows, cols, channels)){
+            continue;
+        }
+        for (const auto& calib : calibrations){
+            if (calib.name == name){
+                rangeImageToPoints(values, rows, cols, channels, calib, points);
+                decoded++;
+                break;
+            }
+        }
+    }
+    return decoded;
+}
+
+#endif // WAYMO_LIDAR_H
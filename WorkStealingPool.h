@@ -0,0 +1,128 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads with one task deque each. A task submitted from a worker goes
+// onto that worker's own deque and is popped LIFO (the frame it just produced is still in
+// its cache); idle workers steal FIFO from the other deques. Tasks from other threads are
+// spread round robin. The deques are short and only contended on a steal, so each is a
+// plain mutex + deque; the rings of LockFreeQueue.h are FIFO only and bounded, while a
+// deque here is popped from both ends and submit() must never fail.
+class WorkStealingPool {
+private:
+    struct Queue {
+        mutex mtx;
+        deque<function<void()>> tasks;
+    };
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> workers;
+    atomic<size_t> next_queue;
+    atomic<int> pending;            // submitted and not yet started
+    atomic<long long> steals;
+    mutex idle_mtx;
+    condition_variable idle_cv;
+    bool stopping;
+
+    // pool and deque of the calling thread, if it is a worker
+    struct WorkerSlot {
+        const WorkStealingPool* pool = nullptr;
+        int index = -1;
+    };
+    static WorkerSlot& currentWorker(){
+        thread_local WorkerSlot slot;
+        return slot;
+    }
+    bool popLocal(int self, function<void()>& task){
+        Queue& q = *queues[self];
+        lock_guard<mutex> lock(q.mtx);
+        if (q.tasks.empty()){
+            return false;
+        }
+        task = move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+    bool steal(int self, function<void()>& task){
+        size_t n = queues.size();
+        for (size_t i = 1; i < n; i++){
+            Queue& q = *queues[(self + i) % n];
+            lock_guard<mutex> lock(q.mtx);
+            if (!q.tasks.empty()){
+                task = move(q.tasks.front());
+                q.tasks.pop_front();
+                steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+    void workerLoop(int self){
+        currentWorker() = WorkerSlot{this, self};
+        function<void()> task;
+        while (true){
+            if (popLocal(self, task) || steal(self, task)){
+                pending--;
+                task();
+                task = nullptr;
+                continue;
+            }
+            unique_lock<mutex> lock(idle_mtx);
+            idle_cv.wait(lock, [&]{ return stopping || pending.load() > 0; });
+            if (stopping && pending.load() == 0){
+                return;
+            }
+        }
+    }
+public:
+    explicit WorkStealingPool(int threads) : next_queue(0), pending(0), steals(0), stopping(false){
+        threads = max(1, threads);
+        for (int i = 0; i < threads; i++){
+            queues.emplace_back(new Queue());
+        }
+        for (int i = 0; i < threads; i++){
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+    // runs what is queued, then joins
+    ~WorkStealingPool(){
+        {
+            lock_guard<mutex> lock(idle_mtx);
+            stopping = true;
+        }
+        idle_cv.notify_all();
+        for (auto& worker : workers){
+            worker.join();
+        }
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(function<void()> task){
+        const WorkerSlot& worker = currentWorker();
+        size_t index = worker.pool == this ? static_cast<size_t>(worker.index) : next_queue++ % queues.size();
+        {
+            lock_guard<mutex> lock(queues[index]->mtx);
+            queues[index]->tasks.push_back(move(task));
+        }
+        {
+            // taken so a worker between its empty check and wait() can't miss the task
+            lock_guard<mutex> lock(idle_mtx);
+            pending++;
+        }
+        idle_cv.notify_one();
+    }
+    int threads() const { return static_cast<int>(workers.size()); }
+    long long stealCount() const { return steals.load(); }
+};
+
+#endif // WORK_STEALING_POOL_H
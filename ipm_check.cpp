@@ -0,0 +1,183 @@
+// Round trip checks of the IPMModel point projections, for the heuristic model and for a
+// calibrated front camera onto the default metric grid:
+//   points - BEV pixels the camera sees -> image -> BEV come back where they started
+//   boxes  - the BEV box of an image box below the horizon holds the ground point of every
+//            pixel in it, a box reaching above the horizon is cut to a finite BEV box and
+//            a box above the horizon is rejected
+//   tiles  - overlapping BevTileCache::warpRect() requests warp every tile under them once
+//            and return the same pixels as the same window of warpInto()
+// Exits non-zero when a check fails:
+//   ./ipm_check [--tolerance=0.01]     (BEV pixels)
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include "Logger.h"
+#include "IPMModel.h"
+using namespace cv;
+using namespace std;
+
+Logger* g_logger = nullptr;
+
+// 1920x1280 camera 1.5 m ahead of the vehicle origin and 2 m above the ground, looking
+// straight ahead (Waymo camera frame: x forward, y left, z up)
+static WaymoCameraCalibration frontCamera(){
+    WaymoCameraCalibration calib;
+    calib.name = 1;
+    calib.width = 1920;
+    calib.height = 1280;
+    double intrinsic[4] = {2000, 2000, 960, 640};
+    copy(intrinsic, intrinsic + 4, calib.intrinsic);
+    double extrinsic[16] = {1, 0, 0, 1.5,
+                            0, 1, 0, 0,
+                            0, 0, 1, 2.0,
+                            0, 0, 0, 1};
+    copy(extrinsic, extrinsic + 16, calib.extrinsic);
+    return calib;
+}
+
+// every 7th BEV pixel the camera sees, to the image and back
+static bool checkPoints(const string& name, const IPMModel& model, double tolerance){
+    const Mat& valid = model.validMask();
+    PointBatch bev, image, back;
+    for (int row = 0; row < valid.rows; row += 7){
+        for (int col = 0; col < valid.cols; col += 7){
+            if (valid.at<uchar>(row, col)){
+                bev.x.push_back(static_cast<float>(col));
+                bev.y.push_back(static_cast<float>(row));
+            }
+        }
+    }
+    bev.valid.assign(bev.x.size(), 1);
+    model.bevToImage(bev, image);
+    model.imageToBev(image, back);
+    size_t lost = 0;
+    double worst = 0;
+    for (size_t i = 0; i < bev.size(); i++){
+        if (!image.valid[i] || !back.valid[i]){
+            lost++;
+            continue;
+        }
+        worst = max(worst, static_cast<double>(hypot(back.x[i] - bev.x[i], back.y[i] - bev.y[i])));
+    }
+    bool ok = bev.size() > 0 && lost == 0 && worst <= tolerance;
+    printf("%-10s points: %zu, %zu without a projection, max error %.5f px  %s\n", name.c_str(), bev.size(), lost, worst,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool checkBoxes(const string& name, const IPMModel& model, Size image_size, double tolerance){
+    const float w = static_cast<float>(image_size.width), h = static_cast<float>(image_size.height);
+    // two boxes near the bottom, one from above the horizon down to the ground, one above it
+    vector<Rect2f> boxes = {Rect2f(0.10f * w, 0.75f * h, 0.20f * w, 0.20f * h),
+                            Rect2f(0.60f * w, 0.80f * h, 0.25f * w, 0.15f * h),
+                            Rect2f(0.40f * w, 0.20f * h, 0.20f * w, 0.70f * h),
+                            Rect2f(0.40f * w, 0.00f * h, 0.20f * w, 0.10f * h)};
+    const bool expected[4] = {true, true, true, false};
+    vector<Rect2f> bev_boxes;
+    vector<uint8_t> ok;
+    model.imageBoxesToBev(boxes, bev_boxes, ok);
+    bool passed = true;
+    for (size_t i = 0; i < boxes.size(); i++){
+        bool good = (ok[i] != 0) == expected[i];
+        if (good && ok[i]){
+            const Rect2f& box = bev_boxes[i];
+            good = isfinite(box.x) && isfinite(box.y) && isfinite(box.width) && isfinite(box.height) &&
+                   box.width > 0 && box.height > 0;
+            // pixels of the lower quarter of the box are on the ground in front of the camera
+            PointBatch inside, projected;
+            for (int sy = 0; sy <= 4; sy++){
+                for (int sx = 0; sx <= 4; sx++){
+                    inside.x.push_back(boxes[i].x + boxes[i].width * sx / 4);
+                    inside.y.push_back(boxes[i].y + boxes[i].height * (0.75f + 0.25f * sy / 4));
+                }
+            }
+            inside.valid.assign(inside.x.size(), 1);
+            model.imageToBev(inside, projected);
+            for (size_t j = 0; j < projected.size() && good; j++){
+                good = projected.valid[j] && projected.x[j] >= box.x - tolerance && projected.x[j] <= box.x + box.width + tolerance &&
+                       projected.y[j] >= box.y - tolerance && projected.y[j] <= box.y + box.height + tolerance;
+            }
+        }
+        printf("%-10s box %zu: %s  %s\n", name.c_str(), i, ok[i] ? "in BEV" : "rejected", good ? "ok" : "FAILED");
+        passed &= good;
+    }
+    return passed;
+}
+
+// tiles under any of the rectangles
+static set<pair<int, int>> tilesUnder(const vector<Rect>& rects){
+    set<pair<int, int>> under;
+    for (const Rect& rect : rects){
+        for (int ty = rect.y / IPMModel::tile_size; ty <= (rect.y + rect.height - 1) / IPMModel::tile_size; ty++){
+            for (int tx = rect.x / IPMModel::tile_size; tx <= (rect.x + rect.width - 1) / IPMModel::tile_size; tx++){
+                under.insert({tx, ty});
+            }
+        }
+    }
+    return under;
+}
+
+// three overlapping rectangles in the middle of the BEV, then the first one twice after a
+// reset for the next frame
+static bool checkTiles(const string& name, const IPMModel& model, Size image_size){
+    Mat image(image_size, CV_8UC3);
+    RNG rng(7);
+    rng.fill(image, RNG::UNIFORM, 0, 255);
+    Mat full;
+    model.warpInto(image, full);
+
+    Size bev = model.bevSize();
+    vector<Rect> rects = {Rect(bev.width / 4, bev.height / 2, bev.width / 3, bev.height / 4),
+                          Rect(bev.width / 3, bev.height / 2 + 20, bev.width / 3, bev.height / 4),
+                          Rect(bev.width / 4 + 10, bev.height / 2 + 10, bev.width / 2, 40)};
+    BevTileCache tiles;
+    tiles.reset(model, image);
+    bool same = true;
+    for (const Rect& rect : rects){
+        Mat region = tiles.warpRect(rect);
+        same &= region.size() == rect.size() && norm(region, full(rect), NORM_INF) == 0;
+    }
+    int first_frame = tiles.tilesComputed();
+    tiles.reset(model, image);
+    tiles.warpRect(rects[0]);
+    tiles.warpRect(rects[0]);
+    int second_frame = tiles.tilesComputed() - first_frame;
+
+    int expected_first = static_cast<int>(tilesUnder(rects).size());
+    int expected_second = static_cast<int>(tilesUnder({rects[0]}).size());
+    bool ok = same && first_frame == expected_first && second_frame == expected_second;
+    printf("%-10s tiles: %d warped for %d requests (%d expected), %d after reset (%d expected), same as warpInto: %s  %s\n",
+           name.c_str(), first_frame, tiles.tilesRequested(), expected_first, second_frame, expected_second, same ? "yes" : "no",
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv){
+    double tolerance = 0.01;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg.rfind("--tolerance=", 0) == 0) tolerance = atof(arg.c_str() + 12);
+    }
+    bool passed = true;
+
+    IPMModel heuristic;
+    Size heuristic_size(1280, 720);
+    heuristic.configure(IPMConfig(), heuristic_size);
+    passed &= checkPoints("heuristic", heuristic, tolerance);
+    passed &= checkBoxes("heuristic", heuristic, heuristic_size, tolerance);
+    passed &= checkTiles("heuristic", heuristic, heuristic_size);
+
+    WaymoCameraCalibration calib = frontCamera();
+    IPMModel calibrated;
+    Size calibrated_size(calib.width, calib.height);
+    calibrated.configure(calib, BevGrid(), calibrated_size);
+    passed &= checkPoints("calibrated", calibrated, tolerance);
+    passed &= checkBoxes("calibrated", calibrated, calibrated_size, tolerance);
+    passed &= checkTiles("calibrated", calibrated, calibrated_size);
+
+    printf(passed ? "all checks passed\n" : "projection checks FAILED\n");
+    return passed ? 0 : 1;
+}
@@ -3,7 +3,28 @@
 #include <chrono>
 #include <iomanip>
 #include <filesystem>
+#include <csignal>
 #include "Logger.h"
+#include "MotionGate.h"
+#include "ResultCache.h"
+#include "Checkpoint.h"
+#include "FrameRange.h"
+#include "DirectoryWatcher.h"
+#include "AsyncFileReader.h"
+#include "TFRecordSource.h"
+#include "WaymoFrame.h"
+#include "IPMModel.h"
+#include "LidarBev.h"
+#include "BevMap.h"
+#include "FrameSinks.h"
+#include "MemoryBudget.h"
+#include "StageGraph.h"
+#include "StaticPipeline.h"
+#include "AsyncExecutor.h"
+#include "FairScheduler.h"
+#include "PreviewWindow.h"
+#include "TelemetryHud.h"
+#include "FrameOps.h"
 //07/03/2025
 // V3: DONE: IPM for front, front_left, front_right.
 // TODO: param1,2 need to be calibrated, figure out camera instrinsic/extrinsic values for calibration
@@ -48,6 +69,16 @@ public:
             last_fps_time = current_time;
         }
     }
+    // totals are saved in job checkpoints and restored on resume
+    TrackerState state() const {
+        return {frame_count, total_processing_time, total_ipm_time, total_pip_time};
+    }
+    void restore(const TrackerState& state){
+        frame_count = state.frame_count;
+        total_processing_time = state.total_processing_time;
+        total_ipm_time = state.total_ipm_time;
+        total_pip_time = state.total_pip_time;
+    }
     void logSummary(){
         if(g_logger && frame_count > 0){
             LOG_INFO("=== Performance Summary ===");
@@ -59,116 +90,535 @@ public:
     }
 };
 
-// Function to perform Inverse Perspective Mapping
-Mat IPM(const Mat& image) {
-    auto start_time = high_resolution_clock::now();
+// Optional --key=value flags, shared by all modes
+struct RunOptions {
+    double reuse_threshold = 0.0;   // motion gate threshold (mean abs diff, 0-255), 0 disables BEV reuse
+    int max_stale_frames = 15;      // force a fresh warp after this many reused frames
+    string cache_dir;               // content-addressed BEV cache, empty disables it
+    int checkpoint_every = 0;       // images mode: frames per output segment + checkpoint, 0 disables
+    bool resume = false;            // images mode: continue from the last checkpoint
+    FrameRange range;               // --start/--end/--stride/--start-time/--end-time
+    bool watch = false;             // images mode: keep processing new files as they appear
+    int watch_window = 8;           // files held back to restore filename order
+    int idle_timeout = 30;          // seconds without new files before a watch ends
+    int prefetch_mb = 64;           // image reads kept in flight ahead of processing, 0 reads synchronously
+    int cycle_length = 4;           // tfrecord mode: files read in parallel
+    int block_length = 1;           // tfrecord mode: consecutive records taken from each file
+    string camera = "FRONT";        // tfrecord mode: camera taken from Waymo Frame records
+    bool lidar = false;             // tfrecord mode: calibrated BEV with the Waymo lidar binned into it
+    double accumulate = 0;          // tfrecord mode: side in meters of the ego-motion stitched map, 0 disables
+    string calibration_file;        // camera calibration for a metric BEV (opts.ipm.grid) in images/video mode
+    bool grid_set = false;          // a --bev-* option was given
+    int bev_levels = 0;             // video/images mode: half-resolution BEV levels warped along with the BEV
+    string preview;                 // video/images mode: downscaled MP4 written next to the full output
+    int preview_width = 320;
+    string thumbnails;              // video/images mode: directory for JPEG thumbnails
+    int thumbnail_every = 30;
+    int thumbnail_width = 320;
+    string shm;                     // video/images mode: shared memory object holding the latest frame
+    string bev_output;              // video/images mode: MP4 of the BEV alone, at the BEV size (the metric grid)
+    int bev_output_level = 0;       // pyramid level written to bev_output (needs bev_levels >= it)
+    int sink_queue = 8;             // frames queued per output sink
+    int memory_mb = 0;              // budget for queued frames + fixed buffers, 0 = unlimited (accounting only)
+    bool pipeline = false;          // run the frame graph on all workers instead of one
+    int threads = 0;                // pipeline workers, 0 = one per core
+    bool static_pipeline = false;   // video mode: loop specialized at compile time (StaticPipeline.h)
+    Size input_size;                // stream mode: size of the raw BGR input frames
+    double display_hz = 10;         // preview window refresh rate, 0 = no window
+    bool hud = false;               // video/images/tfrecord mode: frame / fps / latency / drop overlay in the output
+    double stats_every = 10;        // serve mode: seconds between per-stream metric reports, 0 = only at the end
+    IPMConfig ipm;
+};
+// Split command line into positional args and --key=value options
+bool parseOptions(int argc, char* argv[], vector<string>& args, RunOptions& opts){
+    for (int i = 0; i < argc; i++){
+        string arg = argv[i];
+        if (i == 0 || arg.rfind("--", 0) != 0){
+            args.push_back(arg);
+            continue;
+        }
+        size_t eq = arg.find('=');
+        string key = arg.substr(2, eq == string::npos ? string::npos : eq - 2);
+        string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+        try {
+            if (key == "reuse-threshold"){
+                opts.reuse_threshold = stod(value);
+            } else if (key == "max-stale"){
+                opts.max_stale_frames = stoi(value);
+            } else if (key == "cache-dir"){
+                opts.cache_dir = value;
+            } else if (key == "checkpoint-every"){
+                opts.checkpoint_every = stoi(value);
+            } else if (key == "resume"){
+                opts.resume = true;
+            } else if (key == "start"){
+                opts.range.start = stoi(value);
+            } else if (key == "end"){
+                opts.range.end = stoi(value);
+            } else if (key == "stride"){
+                opts.range.stride = stoi(value);
+            } else if (key == "start-time"){
+                opts.range.start_time = stod(value);
+            } else if (key == "end-time"){
+                opts.range.end_time = stod(value);
+            } else if (key == "watch"){
+                opts.watch = true;
+            } else if (key == "watch-window"){
+                opts.watch_window = stoi(value);
+            } else if (key == "idle-timeout"){
+                opts.idle_timeout = stoi(value);
+            } else if (key == "prefetch-mb"){
+                opts.prefetch_mb = stoi(value);
+            } else if (key == "cycle-length"){
+                opts.cycle_length = stoi(value);
+            } else if (key == "block-length"){
+                opts.block_length = stoi(value);
+            } else if (key == "camera"){
+                opts.camera = value;
+            } else if (key == "lidar"){
+                opts.lidar = true;
+            } else if (key == "accumulate"){
+                opts.accumulate = stod(value);
+            } else if (key == "ipm-param1"){
+                opts.ipm.param1 = stoi(value);
+            } else if (key == "ipm-param2"){
+                opts.ipm.param2 = stoi(value);
+            } else if (key == "mip-levels"){
+                opts.ipm.mip_levels = stoi(value);
+            } else if (key == "bev-levels"){
+                opts.bev_levels = stoi(value);
+            } else if (key == "preview"){
+                opts.preview = value;
+            } else if (key == "preview-width"){
+                opts.preview_width = stoi(value);
+            } else if (key == "thumbnails"){
+                opts.thumbnails = value;
+            } else if (key == "thumbnail-every"){
+                opts.thumbnail_every = stoi(value);
+            } else if (key == "thumbnail-width"){
+                opts.thumbnail_width = stoi(value);
+            } else if (key == "shm"){
+                opts.shm = value;
+            } else if (key == "bev-output"){
+                opts.bev_output = value;
+            } else if (key == "bev-output-level"){
+                opts.bev_output_level = stoi(value);
+            } else if (key == "sink-queue"){
+                opts.sink_queue = stoi(value);
+            } else if (key == "memory-mb"){
+                opts.memory_mb = stoi(value);
+            } else if (key == "pipeline"){
+                opts.pipeline = true;
+            } else if (key == "threads"){
+                opts.threads = stoi(value);
+            } else if (key == "input-size"){
+                size_t x = value.find('x');
+                if (x == string::npos){
+                    throw invalid_argument(value);
+                }
+                opts.input_size = Size(stoi(value.substr(0, x)), stoi(value.substr(x + 1)));
+            } else if (key == "hud"){
+                opts.hud = true;
+            } else if (key == "display-hz"){
+                opts.display_hz = stod(value);
+            } else if (key == "stats-every"){
+                opts.stats_every = stod(value);
+            } else if (key == "static"){
+                opts.static_pipeline = true;
+            } else if (key == "calibration"){
+                opts.calibration_file = value;
+            } else if (key == "bev-lateral"){
+                opts.ipm.grid.lateral_min = -stod(value) / 2;
+                opts.ipm.grid.lateral_max = stod(value) / 2;
+                opts.grid_set = true;
+            } else if (key == "bev-forward"){
+                opts.ipm.grid.forward_max = opts.ipm.grid.forward_min + stod(value);
+                opts.grid_set = true;
+            } else if (key == "bev-forward-min"){
+                double length = opts.ipm.grid.forward_max - opts.ipm.grid.forward_min;
+                opts.ipm.grid.forward_min = stod(value);
+                opts.ipm.grid.forward_max = opts.ipm.grid.forward_min + length;
+                opts.grid_set = true;
+            } else if (key == "bev-resolution"){
+                opts.ipm.grid.resolution = stod(value);
+                opts.grid_set = true;
+            } else {
+                LOG_ERROR("Unknown option: " + arg);
+                return false;
+            }
+        } catch(const exception& e){
+            LOG_ERROR("Invalid value for option " + arg);
+            return false;
+        }
+    }
+    return true;
+}
+// Outputs besides the main MP4 (--preview, --thumbnails, --shm), all fed from the same frames
+bool addOptionalSinks(FrameSinks& sinks, const RunOptions& opts, double fps, Size frame_size){
+    if (!opts.preview.empty()){
+        // even dimensions keep the encoder happy
+        int width = max(2, opts.preview_width & ~1);
+        int height = max(2, static_cast<int>(static_cast<double>(frame_size.height) * width / frame_size.width) & ~1);
+        if (!sinks.add(new VideoFileSink(opts.preview, fps, Size(width, height)), opts.sink_queue, false)){
+            return false;
+        }
+    }
+    if (!opts.thumbnails.empty() &&
+        !sinks.add(new JpegThumbnailSink(opts.thumbnails, opts.thumbnail_every, max(1, opts.thumbnail_width)), 2, true)){
+        return false;
+    }
+    if (!opts.shm.empty() &&
+        !sinks.add(new SharedMemorySink(opts.shm, static_cast<size_t>(frame_size.area()) * 3), 1, true)){
+        return false;
+    }
+    return true;
+}
+// Size of the BEV the IPM stage produces (the metric grid, or the frame for the heuristic
+// warp) at pyramid level --bev-output-level, rounded down to even dimensions for the encoder
+Size bevOutputSize(const RunOptions& opts, Size frame_size){
+    Size bev = opts.ipm.metric ? Size(opts.ipm.grid.cols(), opts.ipm.grid.rows()) : frame_size;
+    for (int l = 0; l < opts.bev_output_level; l++){
+        bev = Size(bev.width / 2, bev.height / 2);
+    }
+    return Size(max(2, bev.width & ~1), max(2, bev.height & ~1));
+}
+// --bev-output: the BEV without the camera frame around it, in its own sinks since the
+// frames differ from the composited output
+bool addBevOutput(FrameSinks& bev_sinks, const RunOptions& opts, double fps, Size frame_size){
+    return opts.bev_output.empty() ||
+           bev_sinks.add(new VideoFileSink(opts.bev_output, fps, bevOutputSize(opts, frame_size)), opts.sink_queue, false);
+}
+// Fixed memory of the IPM stage for frames of `size`: the warp maps when IPMModel does the
+// warp (metric grid, mip levels or a BEV pyramid), the heuristic warpPerspective keeps none
+size_t ipmMapBytes(const RunOptions& opts, Size size){
+    if (!opts.ipm.metric && opts.ipm.mip_levels <= 0 && opts.bev_levels <= 0){
+        return 0;
+    }
+    return IPMModel::mapBytes(opts.ipm.metric ? Size(opts.ipm.grid.cols(), opts.ipm.grid.rows()) : size);
+}
+// Frames on their way through a graph of `workers` (run() keeps workers + 2 in flight): the
+// decoded frame, its BEV and the composited output. The graph bounds their number itself,
+// so they are reserved in the memory budget rather than acquired.
+size_t inFlightBytes(int workers, Size frame_size){
+    return static_cast<size_t>(workers + 2) * frame_size.area() * 3 * 3;
+}
+// The fixed reservations are taken whatever --memory-mb says; a budget they already use up
+// would leave nothing for queued frames, so the run is refused
+bool checkFixedMemory(const MemoryBudget& budget){
+    if (budget.fixedFits()){
+        return true;
+    }
+    LOG_ERROR("--memory-mb=" + to_string(budget.limitBytes() >> 20) + " is less than the " + to_string(budget.fixed() >> 20) +
+              " MB taken up front by IPM maps, read-ahead and frames in flight");
+    return false;
+}
+// --threads, default one per core
+int workerThreads(const RunOptions& opts){
+    return opts.threads > 0 ? opts.threads : max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+// Workers of the frame graphs, each keeps its own IPM maps. Without --pipeline one worker
+// takes the frames one after the other.
+int pipelineThreads(const RunOptions& opts){
+    return opts.pipeline ? workerThreads(opts) : 1;
+}
+// Decoded record handed from the TFRecord reader threads to the processing graph
+struct RecordFrame {
+    int record_index = 0;
+    Mat frame;
+    uint64_t content_hash = 0;
+    bool calibrated = false;                    // Waymo frame with a calibration for the camera
+    WaymoCameraCalibration calibration;
+    double pose[16];                            // vehicle -> world
+    LidarBev lidar;                             // --lidar: occupancy on opts.ipm.grid
+};
+// One frame on its way through a frame graph (runFramePipeline(), tfrecord, three cameras)
+struct PipelineFrame {
+    vector<uchar> bytes;            // encoded image (images mode), decoded by the pipeline
+    Mat frame;                      // decoded frame (video mode) / processing size frame
+    string name;                    // for log messages
+    size_t position = 0;            // images mode: index in the image list
+    uint64_t content_hash = 0;      // cache key of the encoded bytes, 0 = hash the decoded frame
+    bool reuse = false;             // motion gate: take the previous BEV
+    Mat bev;
+    vector<Mat> pyramid;            // --bev-levels
+    Mat output;
+    double ipm_ms = 0;
+    double pip_ms = 0;
+    high_resolution_clock::time_point start;
+    // tfrecord mode
+    size_t file_index = 0;
+    RecordFrame record;             // calibration, pose and lidar (record.frame is frame)
+    shared_ptr<const IPMModel> model;   // calibrated warp of the record's file, null: heuristic IPM
+    vector<size_t> finished;        // input files with no records after this one
+    // three-camera mode: encoded image, BEV and warp time per camera
+    vector<uchar> views[3];
+    Mat view_frames[3];             // decoded, released once combined
+    bool view_reuse[3] = {false, false, false};
+    Mat view_bevs[3];
+    double view_ms[3] = {0, 0, 0};
+};
+// The per-frame work of the video / images graph. The stream processor runs the same steps
+// one frame at a time and tfrecord mode composites with it, so every mode decodes, gates,
+// warps, composites and times frames the same way. gate() and composite() keep state across
+// frames and must see them in order; decode(), resizeFrame() and warp() run on any thread.
+class FrameStages {
+private:
+    Size frame_size;
+    const RunOptions& opts;
+    ResultCache& cache;
+    MotionGate* motion_gate;        // nullptr: no BEV reuse
+    TelemetryHud* hud;
+    const FrameSinks* sinks;        // their drops are shown in the HUD
+    uint64_t config_hash;
+    bool have_bev;
+    atomic<bool> cache_slow;        // hits cost more than warping, the cache is left alone
+    atomic<bool> warp_failed;       // set by composite(), the gate then forgets its key frame
+    Mat last_bev;
+    vector<Mat> last_pyramid;
+    long long composited;
+public:
+    atomic<long long> skipped;      // frames that failed to decode
 
-    int height = image.rows;
-    int width = image.cols;
-    LOG_DEBUG("IPM: Processing frame " + to_string(width) + "x" + to_string(height));
+    FrameStages(Size frame_size, const RunOptions& opts, ResultCache& cache, MotionGate* motion_gate,
+                TelemetryHud* hud = nullptr, const FrameSinks* sinks = nullptr)
+        : frame_size(frame_size), opts(opts), cache(cache), motion_gate(motion_gate), hud(hud), sinks(sinks),
+          config_hash(opts.ipm.hash()), have_bev(false), cache_slow(false), warp_failed(false), composited(0), skipped(0){}
 
-    // Parameters (hard-coded need to be fixed)
-    int param1 = 570;
-    int param2 = 35;
-    
-    // Define source points for perspective transformation
-    vector<Point2f> original_points = {
-        Point2f(0, (height / 2) + param2),          // Top-left of the lower half
-        Point2f(width, (height / 2) + param2),      // Top-right of the lower half
-        Point2f(width, height),                     // Bottom-right corner
-        Point2f(0, height)                          // Bottom-left corner
-    };
-    
-    // Define destination points for perspective transformation
-    vector<Point2f> destination_points = {
-        Point2f(0, 0),                              // Top-left corner
-        Point2f(width, 0),                          // Top-right corner
-        Point2f(width - param1, height * 2),        // Bottom-right corner
-        Point2f(param1, height * 2)                 // Bottom-left corner
-    };
-    try {
-        // Compute and apply the perspective transformation
-        Mat matrix = getPerspectiveTransform(original_points, destination_points);
-        Mat warped_image;
-        warpPerspective(image, warped_image, matrix, Size(width, height * 2));
-        
-        // Resize back to original dimensions
-        Mat final_warped_image;
-        resize(warped_image, final_warped_image, Size(width, height));
-
-        auto end_time = high_resolution_clock::now();
-        auto duration = duration_cast<milliseconds>(end_time - start_time);
-        double ms = duration.count() / 1000.0;
-        
-        // Log performances
-        if (ms > 10.0){
-            LOG_WARNING("IPM processing slow: " + to_string(ms) + "ms");
-        }
-        return final_warped_image;
-        
-    } catch(const exception& e){
-        LOG_ERROR("IPM failed: " + string(e.what()));
-        return image; // return original image on failure
+    // encoded bytes (if any) into frame; false drops a frame that can't be decoded
+    bool decode(PipelineFrame& task){
+        if (!task.bytes.empty()){
+            if (cache.enabled()){
+                task.content_hash = hashBytes(task.bytes.data(), task.bytes.size());
+            }
+            task.frame = imdecode(task.bytes, IMREAD_COLOR);
+            task.bytes = vector<uchar>();
+        }
+        if (task.frame.empty()){
+            LOG_WARNING("Failed to read image: " + task.name + " - skipping");
+            skipped++;
+            return false;
+        }
+        return true;
+    }
+    void resizeFrame(PipelineFrame& task){
+        resize(task.frame, task.frame, frame_size);
+    }
+    // the gate compares consecutive frames, so it runs in order ahead of the warp
+    void gate(PipelineFrame& task){
+        if (warp_failed.exchange(false) && motion_gate){
+            motion_gate->invalidate();
+        }
+        task.reuse = motion_gate && motion_gate->reuse(task.frame) && have_bev;
+        have_bev = true;
+    }
+    void warp(PipelineFrame& task){
+        if (task.reuse){
+            return;
+        }
+        auto ipm_start = high_resolution_clock::now();
+        // a hit only saves the warp here (the frame is decoded anyway) but decodes a whole
+        // PNG; the first frames are warped to time that, and once hits turn out slower the
+        // cache is skipped (typically the heuristic IPM of video frames)
+        double hit_ms = 0, warp_ms = 0;
+        if (cache.enabled() && !cache_slow && cache.slowerThanWarp(hit_ms, warp_ms) && !cache_slow.exchange(true)){
+            LOG_WARNING("Result cache hits take " + to_string(hit_ms) + "ms, the warp " + to_string(warp_ms) +
+                        "ms: not using the cache for the rest of the run");
+        }
+        if (cache.enabled() && !cache_slow){
+            CacheKey key = {task.content_hash ? task.content_hash : hashMat(task.frame), config_hash, frame_size};
+            task.bev = cachedIPM(task.frame, cache, key, opts.ipm, !cache.needsWarpTiming(), &task.pyramid, opts.bev_levels);
+        } else if (opts.bev_levels > 0){
+            task.bev = IPMPyramid(task.frame, task.pyramid, opts.bev_levels, opts.ipm);
+        } else {
+            task.bev = IPM(task.frame, opts.ipm);
+        }
+        task.ipm_ms = duration_cast<microseconds>(high_resolution_clock::now() - ipm_start).count() / 1000.0;
+    }
+    // BEV (the previous one for reused frames) into the frame, HUD, frame_size output
+    void composite(PipelineFrame& task){
+        // frames gated before a failed warp was seen have nothing to reuse
+        if (task.reuse && last_bev.empty()){
+            task.reuse = false;
+            warp(task);
+        }
+        if (task.reuse){
+            task.bev = last_bev;
+            task.pyramid = last_pyramid;
+        } else if (task.bev.data == task.frame.data){
+            // IPM hands back the input when the warp fails: don't reuse the camera image as
+            // the BEV, and have the gate warp the next frame
+            last_bev.release();
+            last_pyramid.clear();
+            warp_failed = true;
+        } else {
+            last_bev = task.bev;
+            last_pyramid = task.pyramid;
+        }
+        auto pip_start = high_resolution_clock::now();
+        task.frame = pictureInPicture(task.frame, pyramidLevel(task.pyramid, task.bev, task.frame.rows / 3));
+        task.pip_ms = duration_cast<microseconds>(high_resolution_clock::now() - pip_start).count() / 1000.0;
+        composited++;
+        if (hud){
+            double total_ms = duration_cast<microseconds>(high_resolution_clock::now() - task.start).count() / 1000.0;
+            hud->drawStats(task.frame, composited, task.ipm_ms, task.pip_ms, total_ms, skipped + (sinks ? sinks->dropped() : 0));
+        }
+        if (task.frame.size() == frame_size){
+            task.output = task.frame;
+        } else {
+            resize(task.frame, task.output, frame_size);
+        }
+    }
+};
+// Frame times into the tracker, progress every 100 frames and a warning when a frame spent
+// longer than its share of the frame interval in the graph (frames overlap on `workers`)
+void recordFrame(PerformanceTracker& perf_tracker, const PipelineFrame& task, int frame_number, double fps, int workers){
+    double total_frame_time = duration_cast<microseconds>(high_resolution_clock::now() - task.start).count() / 1000.0;
+    perf_tracker.updateFrameStats(total_frame_time, task.ipm_ms, task.pip_ms);
+    if (frame_number % 100 == 0){
+        LOG_INFO("Processed " + to_string(frame_number) + " frames");
+    }
+    double target_ms = 1000.0 * max(1, workers) / fps;
+    if (total_frame_time > target_ms){
+        LOG_WARNING("Frame " + to_string(frame_number) + " latency " + to_string(total_frame_time) + "ms (target " +
+                    to_string(target_ms) + "ms at " + to_string(fps) + " fps)");
     }
 }
+// The BEV of a composited frame (pyramid level --bev-output-level) into the --bev-output
+// sinks. A failed warp hands back the camera frame, that is written black so the BEV video
+// keeps one frame per output frame.
+void pushBev(FrameSinks& bev_sinks, const PipelineFrame& task, const RunOptions& opts){
+    if (bev_sinks.empty()){
+        return;
+    }
+    int level = opts.bev_output_level;
+    bool failed = task.bev.empty() || task.bev.data == task.frame.data;
+    if (failed || (level > 0 && static_cast<int>(task.pyramid.size()) <= level)){
+        bev_sinks.push(Mat::zeros(bevOutputSize(opts, task.frame.size()), CV_8UC3));
+        return;
+    }
+    bev_sinks.push(level > 0 ? task.pyramid[level] : task.bev);
+}
+// The read -> decode -> resize -> gate -> IPM -> composite -> {encode, display} graph of the
+// video and images modes. Without --pipeline it has one worker, which takes the frames one
+// after the other while source() reads ahead on this thread; with --pipeline decode, resize
+// and IPM of several frames overlap. source() fills frame or bytes. encode() gets the
+// composited frames in order (segments can be cut there) and stops the run by returning
+// false; 'q' in the preview window stops it too. Returns the number of frames read.
+int runFramePipeline(const function<bool(PipelineFrame&)>& source, const function<bool(PipelineFrame&)>& encode,
+                     FrameStages& stages, PerformanceTracker& perf_tracker, PreviewWindow& display, double fps,
+                     const RunOptions& opts){
+    WorkStealingPool pool(pipelineThreads(opts));
+    StageGraph<PipelineFrame> graph(pool);
+    int workers = pool.threads();
 
-// Function to create picture-in-picture overlay
-Mat pictureInPicture(Mat main_image, const Mat& overlay_image, 
-                    int img_ratio = 3, int border_size = 3, 
-                    int x_margin = 30, int y_offset_adjust = -100) {
-    
-    if (main_image.empty() || overlay_image.empty()) {
-        LOG_ERROR("PIP: One or both images are empty");
-        return main_image; // is this necessary?
+    int decode = graph.addStage("decode", [&](PipelineFrame& task){ return stages.decode(task); }, workers);
+    int resize_stage = graph.addStage("resize", [&](PipelineFrame& task){
+        stages.resizeFrame(task);
+        return true;
+    }, workers);
+    int gate = graph.addStage("gate", [&](PipelineFrame& task){
+        stages.gate(task);
+        return true;
+    }, 1, true);
+    int ipm = graph.addStage("ipm", [&](PipelineFrame& task){
+        stages.warp(task);
+        return true;
+    }, workers);
+    int composite = graph.addStage("composite", [&](PipelineFrame& task){
+        stages.composite(task);
+        return true;
+    }, 1, true);
+    // the frame times are recorded here, in output order, so a segment cut by encode()
+    // checkpoints exactly the frames written before it
+    atomic<bool> stopped(false);
+    int frames_done = 0;
+    int encode_stage = graph.addStage("encode", [&](PipelineFrame& task){
+        if (stopped || !encode(task)){
+            stopped = true;
+            return false;
+        }
+        recordFrame(perf_tracker, task, ++frames_done, fps, workers);
+        return true;
+    }, 1, true);
+    // the window is drawn on the preview thread, the stage only offers the frame
+    int display_stage = graph.addStage("display", [&](PipelineFrame& task){
+        display.show(task.output);
+        return true;
+    }, 1, true);
+    graph.connect(decode, resize_stage);
+    graph.connect(resize_stage, gate);
+    graph.connect(gate, ipm);
+    graph.connect(ipm, composite);
+    graph.connect(composite, encode_stage);
+    graph.connect(composite, display_stage);
+
+    int frames_read = 0;
+    auto read = [&](PipelineFrame& task){
+        task.start = high_resolution_clock::now();
+        if (!source(task)){
+            return false;
+        }
+        frames_read++;
+        return true;
+    };
+    auto idle = [&]{ return !display.cancelled() && !stopped; };
+    graph.run(read, workers + 2, idle);
+    graph.logSummary("Pipeline");
+    return frames_read;
+}
+// resize -> IPM -> PIP of one stream, one frame at a time (on whatever thread runs it), with
+// the steps of the frame graph. Keeps the stream's motion gate and last BEV between frames.
+class FrameProcessor {
+private:
+    Size frame_size;
+    MotionGate motion_gate;
+    FrameStages stages;
+public:
+    FrameProcessor(Size frame_size, ResultCache& cache, const RunOptions& opts)
+        : frame_size(frame_size), motion_gate(opts.reuse_threshold, opts.max_stale_frames),
+          stages(frame_size, opts, cache, &motion_gate){}
+    // composited frame_size output, a new buffer per call
+    Mat process(const Mat& input, double& ipm_ms, double& pip_ms){
+        PipelineFrame task;
+        task.start = high_resolution_clock::now();
+        resize(input, task.frame, frame_size);
+        stages.gate(task);
+        stages.warp(task);
+        stages.composite(task);
+        ipm_ms = task.ipm_ms;
+        pip_ms = task.pip_ms;
+        return task.output;
     }
-    try {
-        // Resize the overlay image to 1/img_ratio of the main image height
-        int new_height = main_image.rows / img_ratio;
-        int new_width = static_cast<int>(new_height * (static_cast<double>(overlay_image.cols) / overlay_image.rows));
-        
-        Mat overlay_resized;
-        resize(overlay_image, overlay_resized, Size(new_width, new_height));
-        
-        // Add a white border to the overlay image
-        Mat overlay_with_border;
-        copyMakeBorder(overlay_resized, overlay_with_border, 
-                    border_size, border_size, border_size, border_size,
-                    BORDER_CONSTANT, Scalar(255, 255, 255));
-        
-        // Determine overlay position
-        int x_offset = main_image.cols - overlay_with_border.cols - x_margin;
-        int y_offset = (main_image.rows / 2) - overlay_with_border.rows + y_offset_adjust;
-        
-        // Ensure the overlay fits within the main image bounds
-        if (x_offset >= 0 && y_offset >= 0 && 
-            x_offset + overlay_with_border.cols <= main_image.cols &&
-            y_offset + overlay_with_border.rows <= main_image.rows) {
-            
-            // Create ROI and copy overlay
-            Rect roi(x_offset, y_offset, overlay_with_border.cols, overlay_with_border.rows);
-            overlay_with_border.copyTo(main_image(roi));
-        }
-        
-        return main_image;
-    } catch(const exception& e){
-        LOG_ERROR("PIP failed: " + string(e.what()));
-        return main_image;
+    void logSummary(const string& name){ motion_gate.logSummary(name); }
+};
+// Read a whole file into memory (for hashing and imdecode without a second read)
+bool readFileBytes(const string& path, vector<uchar>& bytes){
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file.is_open()){
+        return false;
     }
+    streamsize size = file.tellg();
+    file.seekg(0, ios::beg);
+    bytes.resize(size);
+    return size > 0 && file.read(reinterpret_cast<char*>(bytes.data()), size).good();
+}
+// check if file has valid image extension
+bool isImageFile(const string& path){
+    vector<string> valid_extensions = {".jpg", ".jpeg", ".png"};
+    string extension = fs::path(path).extension().string();
+    // convert extension to lowercase for comparison
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return find(valid_extensions.begin(), valid_extensions.end(), extension) != valid_extensions.end();
 }
 //Get list of image files from diretory
 vector<string> getImageFiles(const string& directory_path){
-    vector<string> valid_extensions = {".jpg", ".jpeg", ".png"};
     vector<string> image_files;
 
     try {
         for (const auto& entry : fs::directory_iterator(directory_path)){
             if(entry.is_regular_file()){
                 string file_path = entry.path().string();
-                string extension = entry.path().extension().string();
-                // convert extension to lowercase for comparison
-                transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-                // check if file has valid image extension
-                if (find(valid_extensions.begin(), valid_extensions.end(), extension) != valid_extensions.end()){
+                if (isImageFile(file_path)){
                     image_files.push_back(file_path);
                 }
             }
@@ -181,105 +631,201 @@ vector<string> getImageFiles(const string& directory_path){
     }
     return image_files;
 }
-int processImageSequence(const string& input_dir, const string& output_video_path, double fps =30.0, int frame_width = 1280, int frame_height = 800){
+int processImageSequence(const string& input_dir, const string& output_video_path, double fps =30.0, int frame_width = 1280, int frame_height = 800,
+                         const RunOptions& opts = RunOptions()){
     LOG_INFO("=== Image Sequence Processing Started ===");
     LOG_INFO("Input Directory: " + input_dir);
     LOG_INFO("Output Video: " + output_video_path);
 
+    // Watch mode: start watching before listing so files written in between aren't lost.
+    // The list then grows as the producer finishes new files.
+    unique_ptr<DirectoryWatcher> watcher;
+    if (opts.watch){
+        if (opts.checkpoint_every > 0){
+            LOG_ERROR("--checkpoint-every cannot be combined with --watch");
+            return -1;
+        }
+        watcher.reset(new DirectoryWatcher(input_dir, isImageFile, opts.watch_window, 500, opts.idle_timeout * 1000));
+        if (!watcher->start()){
+            return -1;
+        }
+    }
     // Get list of image files
     vector<string> image_files = getImageFiles(input_dir);
-    if (image_files.empty()){
+    if (image_files.empty() && !watcher){
         LOG_ERROR("No valid image files found in directory: " + input_dir);
         return -1;
     }
+    // frame range by arrival index, files outside it are never read
+    FrameRange watch_range = opts.range.resolve(fps, -1);
+    int arrivals = 0;
+    if (watcher){
+        watcher->addExisting(image_files);
+        image_files.clear();
+    }
+    // Frame range: skipped images are dropped from the list, never read or decoded
+    else if (!opts.range.isFull()){
+        FrameRange range = opts.range.resolve(fps, image_files.size());
+        image_files = range.select(image_files);
+        LOG_INFO("Frame range " + range.describe() + ": " + to_string(image_files.size()) + " images selected");
+        if (image_files.empty()){
+            LOG_ERROR("Frame range selects no images");
+            return -1;
+        }
+    }
     // Perf Tracker
     PerformanceTracker perf_tracker;
-    // Create VideoWriter object
-    VideoWriter out(output_video_path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, Size(frame_width, frame_height));
-    if (!out.isOpened()){
-        LOG_ERROR("Unable to create output video file: " + output_video_path);
+    MotionGate motion_gate(opts.reuse_threshold, opts.max_stale_frames);
+    ResultCache cache(opts.cache_dir);
+
+    // With checkpointing the output is split into segments, each one finalized together
+    // with a checkpoint so a restarted job continues after the last committed segment
+    bool checkpointing = opts.checkpoint_every > 0;
+    string checkpoint_path = JobCheckpoint::pathFor(output_video_path);
+    JobCheckpoint checkpoint;
+    size_t start_index = 0;
+    if (checkpointing && opts.resume && checkpoint.load(checkpoint_path)){
+        if (!checkpoint.matches(input_dir, image_files)){
+            LOG_ERROR("Checkpoint " + checkpoint_path + " does not match the images in " + input_dir);
+            return -1;
+        }
+        if (checkpoint.completed){
+            LOG_INFO("Job already completed according to " + checkpoint_path);
+            return 0;
+        }
+        start_index = checkpoint.next_index;
+        perf_tracker.restore(checkpoint.tracker);
+        LOG_INFO("Resuming at image " + to_string(start_index + 1) + "/" + to_string(image_files.size()) +
+                 ", segment " + to_string(checkpoint.next_segment));
+    } else if (checkpointing){
+        checkpoint.input_dir = input_dir;
+        checkpoint.file_count = image_files.size();
+        checkpoint.writeSegmentList(output_video_path);
+    }
+    string current_output = checkpointing ? JobCheckpoint::segmentPath(output_video_path, checkpoint.next_segment)
+                                          : output_video_path;
+    // Output frames go to the MP4 and any extra sinks, each encoding on its own thread;
+    // frames queued for them count against the memory budget
+    MemoryBudget budget(size_t(max(0, opts.memory_mb)) << 20);
+    budget.reserve("ipm maps", ipmMapBytes(opts, Size(frame_width, frame_height)) * pipelineThreads(opts));
+    budget.reserve("in flight", inFlightBytes(pipelineThreads(opts), Size(frame_width, frame_height)));
+    if (!watcher && opts.prefetch_mb > 0){
+        budget.reserve("prefetch", size_t(opts.prefetch_mb) << 20);
+    }
+    if (!checkFixedMemory(budget)){
+        return -1;
+    }
+    // a resumed job numbers its frames (thumbnail names) after the committed ones
+    FrameSinks sinks(&budget, static_cast<int>(start_index));
+    VideoFileSink* out = sinks.add(new VideoFileSink(current_output, fps, Size(frame_width, frame_height)), opts.sink_queue, false);
+    FrameSinks bev_sinks(&budget);
+    if (!out || !addOptionalSinks(sinks, opts, fps, Size(frame_width, frame_height)) ||
+        !addBevOutput(bev_sinks, opts, fps, Size(frame_width, frame_height))){
         return -1;
     }
     LOG_INFO("Video writer initialized successfully");
-    LOG_INFO("Processing " + to_string(image_files.size()) + " images at " + to_string(fps) + " fps");
-    Mat frame, frame_ipm;
-    int frame_number = 0;
-    auto total_start_time = high_resolution_clock::now();
-    // Process each image
-    for (const string& image_path : image_files){
-        auto frame_start_time = high_resolution_clock::now();
-        frame_number++;
+    // prefetch upcoming images (the watch list isn't known in advance, it reads synchronously)
+    unique_ptr<AsyncFileReader> reader;
+    if (!watcher){
+        LOG_INFO("Processing " + to_string(image_files.size() - start_index) + " images at " + to_string(fps) + " fps");
+        if (opts.prefetch_mb > 0){
+            vector<string> upcoming(image_files.begin() + start_index, image_files.end());
+            reader.reset(new AsyncFileReader(upcoming, size_t(opts.prefetch_mb) << 20));
+        }
+    }
+    int segment_frames = 0;
 
-        // Log progress every 100 frames
-        if (frame_number % 100 == 0){
-            LOG_INFO("Processing image " + to_string(frame_number) + "/" + to_string(image_files.size()) + " (" + to_string((frame_number * 100) / image_files.size()) + "%)");
+    // Finalize the current segment, then record it in the checkpoint (in that order)
+    auto commitSegment = [&](size_t next_index, bool completed) -> bool {
+        // the encoder thread is idle after flush(), the segment can be finalized from here
+        sinks.flush();
+        out->close();
+        if (segment_frames > 0){
+            checkpoint.next_segment++;
         }
-        try {
-            // read image
-            frame = imread(image_path);
-            if (frame.empty()){
-                LOG_WARNING("Failed to read image: " + image_path + " - skipping");
-                continue;
-            }
-            // Resize frame to desired dimensions
-            resize(frame, frame, Size(frame_width, frame_height));
-            // Apply IPM transformation with timing
-            PERF_START("IPM Transform");
-            auto ipm_start = high_resolution_clock::now();
-            frame_ipm = IPM(frame);
-            auto ipm_end = high_resolution_clock::now();
-            PERF_END("IPM_Transform");
-
-            PERF_START("PIP_Overlay");
-            auto pip_start = high_resolution_clock::now();
-            // Apply picture-in-picture overlay
-            frame = pictureInPicture(frame, frame_ipm);
-            auto pip_end = high_resolution_clock::now();
-            PERF_END("PIP_Overlay");
-            
-            // Calculate individual timing
-            double ipm_time = duration_cast<microseconds>(ipm_end - ipm_start).count() / 1000.0;
-            double pip_time = duration_cast<microseconds>(pip_end - pip_start).count() / 1000.0;
-            
-            // Display the frame
-            imshow("Frame", frame);
-            
-            Mat output_frame;
-            resize(frame, output_frame, Size(frame_width, frame_height));
-            out.write(output_frame);
-
-            // Calculate total frame processing time
-            auto frame_end_time = high_resolution_clock::now();
-            double total_frame_time = duration_cast<microseconds>(frame_end_time - frame_start_time).count() / 1000.0;
-
-            // Update perf tracker
-            perf_tracker.updateFrameStats(total_frame_time, ipm_time, pip_time);
-
-            //Check for real-time perf
-            double target_frame_time = 1000.0 / fps;
-            if (total_frame_time > target_frame_time){
-                LOG_WARNING("Frame " + to_string(frame_number) + " processing slow: " + 
-                           to_string(total_frame_time) + "ms (target: " + to_string(target_frame_time) + "ms for " + 
-                           to_string(fps) + " fps)");
+        checkpoint.next_index = next_index;
+        checkpoint.last_file = next_index > 0 ? image_files[next_index - 1] : "";
+        checkpoint.completed = completed;
+        checkpoint.tracker = perf_tracker.state();
+        if (!checkpoint.writeSegmentList(output_video_path) || !checkpoint.save(checkpoint_path)){
+            LOG_ERROR("Failed to write checkpoint " + checkpoint_path);
+            return false;
+        }
+        segment_frames = 0;
+        if (completed){
+            return true;
+        }
+        // an empty segment is not listed, its number gets reused
+        current_output = JobCheckpoint::segmentPath(output_video_path, checkpoint.next_segment);
+        return out->reopen(current_output);
+    };
+
+    // next image from the list, or in watch mode the next file the watcher hands out
+    auto haveImage = [&](size_t index) -> bool {
+        while (watcher && index >= image_files.size()){
+            string path;
+            if (watch_range.end >= 0 && arrivals >= watch_range.end){
+                return false;
+            }
+            if (!watcher->next(path)){
+                return false;
+            }
+            if (watch_range.contains(arrivals++)){
+                image_files.push_back(path);
             }
+        }
+        return index < image_files.size();
+    };
 
-        } catch(const exception& e){
-            LOG_ERROR("Error processing image " + image_path + ": " + e.what());
-            continue; // Skip current image and continue
+    size_t image_index = start_index;
+    PreviewWindow display("Frame", opts.display_hz);
+    unique_ptr<TelemetryHud> hud(opts.hud ? new TelemetryHud() : nullptr);
+    FrameStages stages(Size(frame_width, frame_height), opts, cache, &motion_gate, hud.get(), &sinks);
+    bool commit_failed = false;
+    auto total_start_time = high_resolution_clock::now();
+    int frame_number = runFramePipeline([&](PipelineFrame& task){
+        if (!haveImage(image_index)){
+            return false;
         }
-        // Press 'q' to exit
-        if (waitKey(1) == 'q') {
-            LOG_INFO("Processing interrupted");
-            break;
+        // read in list order (prefetched), the bytes are hashed and decoded on the workers
+        task.position = image_index;
+        task.name = image_files[image_index++];
+        string read_path = task.name;
+        if (reader){
+            reader->next(read_path, task.bytes);
+        } else {
+            readFileBytes(task.name, task.bytes);
         }
+        return true;
+    }, [&](PipelineFrame& task){
+        // segments are cut between frames in output order, frames still in flight go into
+        // the next segment
+        if (checkpointing && segment_frames >= opts.checkpoint_every && !commitSegment(task.position, false)){
+            commit_failed = true;
+            return false;
+        }
+        sinks.push(task.output);
+        pushBev(bev_sinks, task, opts);
+        segment_frames++;
+        return true;
+    }, stages, perf_tracker, display, fps, opts);
+    if (commit_failed){
+        return -1;
     }
     // calculate total processing time
     auto total_end_time = high_resolution_clock::now();
     double total_processing_seconds = duration_cast<milliseconds>(total_end_time -total_start_time).count() / 1000.0;
 
     // Release video objects and close windows
-    out.release();
-    destroyAllWindows();
+    if (checkpointing){
+        // an interrupted job commits what it has and can be resumed later
+        commitSegment(image_index, image_index >= image_files.size());
+        LOG_INFO("Segments listed in " + JobCheckpoint::segmentListPath(output_video_path) + ", join with: ffmpeg -f concat -safe 0 -i " +
+                 JobCheckpoint::segmentListPath(output_video_path) + " -c copy " + output_video_path);
+    }
+    sinks.close();
+    bev_sinks.close();
+    display.close();
 
     // Log final performance summary
     LOG_INFO("=== Image Sequence Processing Completed ===");
@@ -288,14 +834,25 @@ int processImageSequence(const string& input_dir, const string& output_video_pat
     LOG_INFO("Video saved as: " + output_video_path);
     
     perf_tracker.logSummary();
+    sinks.logSummary();
+    bev_sinks.logSummary();
+    budget.logSummary();
+    if (hud){
+        hud->logSummary();
+    }
+    motion_gate.logSummary("images");
+    cache.logSummary();
     
     return 0;
 }   
-int processVideo(const string& input_video_path, const string& output_video_path, int frame_width = 1280, int frame_height = 800){
+int processVideo(const string& input_video_path, const string& output_video_path, int frame_width = 1280, int frame_height = 800,
+                 const RunOptions& opts = RunOptions()){
     LOG_INFO("=== IPM Video Processing Started ===");
 
     // Performance Tracker
     PerformanceTracker perf_tracker;
+    MotionGate motion_gate(opts.reuse_threshold, opts.max_stale_frames);
+    ResultCache cache(opts.cache_dir);
 
     // Input and output file paths
     //string input_video_path = "../output_front.mp4";
@@ -320,102 +877,78 @@ int processVideo(const string& input_video_path, const string& output_video_path
     LOG_INFO("Video properties: " + to_string(frame_width) + "x" + to_string(frame_height) + 
              " @ " + to_string(fps) + " fps, " + to_string(total_frames) + " frames");
     
-    // Create VideoWriter object
-    VideoWriter out(output_video_path, VideoWriter::fourcc('m', 'p', '4', 'v'), 
-                    fps, Size(frame_width, frame_height));
-    
-    if (!out.isOpened()) {
-        LOG_ERROR("Unable to create output video file: " + output_video_path);
+    // Output frames go to the MP4 and any extra sinks, each encoding on its own thread;
+    // frames queued for them count against the memory budget
+    MemoryBudget budget(size_t(max(0, opts.memory_mb)) << 20);
+    budget.reserve("ipm maps", ipmMapBytes(opts, Size(frame_width, frame_height)) * pipelineThreads(opts));
+    budget.reserve("in flight", inFlightBytes(pipelineThreads(opts), Size(frame_width, frame_height)));
+    if (!checkFixedMemory(budget)){
+        delete g_logger;
+        return -1;
+    }
+    FrameSinks sinks(&budget);
+    FrameSinks bev_sinks(&budget);
+    if (!sinks.add(new VideoFileSink(output_video_path, fps, Size(frame_width, frame_height)), opts.sink_queue, false) ||
+        !addOptionalSinks(sinks, opts, fps, Size(frame_width, frame_height)) ||
+        !addBevOutput(bev_sinks, opts, fps, Size(frame_width, frame_height))) {
         delete g_logger;
         return -1;
     }
     LOG_INFO("Video writer initialized successfully");
 
-    Mat frame, frame_ipm;
-    int frame_number = 0;
-    auto total_start_time = high_resolution_clock::now();
-
-    // Process the video
-    while (true) {
-        auto frame_start_time = high_resolution_clock::now();
+    // Frame range: seek to the first frame and skip between strides without retrieving
+    FrameRange range = opts.range.resolve(fps, total_frames > 0 ? total_frames : -1);
+    int selected_frames = (range.count() >= 0) ? range.count() : total_frames;
+    if (!opts.range.isFull()){
+        LOG_INFO("Frame range " + range.describe() + ": " + to_string(selected_frames) + " frames selected");
+    }
+    // beyond this many skipped frames a seek (to the nearest keyframe) beats grabbing
+    const int seek_threshold = 30;
+    int next_index = range.start;   // next frame to process
+    int source_index = 0;           // frame the capture returns next
 
-        bool ret = cap.read(frame);
-        if (!ret) {
-            LOG_INFO("End of video reached. Processed " + to_string(frame_number) + " frames");
-            break;
+    // next frame of the range into out, false at the end
+    auto readFrame = [&](Mat& out) -> bool {
+        if (range.end >= 0 && next_index >= range.end){
+            LOG_INFO("End of frame range reached");
+            return false;
         }
-        frame_number++;
-        // Log Process every 100 frames
-        if (frame_number % 100 == 0){
-            LOG_INFO("Processing frame " + to_string(frame_number) + "/" + to_string(total_frames));
-        }
-        try{
-            // Resize frame to desired dimensions
-            resize(frame, frame, Size(frame_width, frame_height));
-            
-            // apply IPM transformation with timing
-            PERF_START("IPM_Transform");
-            auto ipm_start = high_resolution_clock::now();
-            // Apply IPM transformation
-            frame_ipm = IPM(frame);
-            auto ipm_end = high_resolution_clock::now();
-            PERF_END("IPM_Transform");
-
-            PERF_START("PIP_Overlay");
-            auto pip_start = high_resolution_clock::now();
-            // Apply picture-in-picture overlay
-            frame = pictureInPicture(frame, frame_ipm);
-            auto pip_end = high_resolution_clock::now();
-            PERF_END("PIP_Overlay");
-
-            // Calculate individual timing
-            double ipm_time = duration_cast<microseconds>(ipm_end - ipm_start).count() / 1000.0;
-            double pip_time = duration_cast<microseconds>(pip_end - pip_start).count() / 1000.0;
-
-            // For side-by-side instead of PIP, uncomment the following lines:
-            // Mat frame_ipm_resized;
-            // resize(frame_ipm, frame_ipm_resized, Size(frame_width/2, frame_height));
-            // Mat combined;
-            // hconcat(frame, frame_ipm_resized, combined);
-            // frame = combined;
-            
-            // Display the frame
-            imshow("Frame", frame);
-            
-            // Ensure frame is correct size before writing
-            Mat output_frame;
-            resize(frame, output_frame, Size(frame_width, frame_height));
-            out.write(output_frame);
-
-            // Calculate total frame processing time
-            auto frame_end_time = high_resolution_clock::now();
-            double total_frame_time = duration_cast<microseconds>(frame_end_time - frame_start_time).count() / 1000.0;
-
-            // update performance tracker
-            perf_tracker.updateFrameStats(total_frame_time, ipm_time, pip_time);
-
-            //check for real-time per, targeting 30 fps target
-            if (total_frame_time > 30){
-                LOG_WARNING("Frame " + to_string(frame_number) + " processing slow: " + to_string(total_frame_time) + "ms (target 30 fps)");
-            }
-        } catch(const exception& e){
-            LOG_ERROR("Error processing frame " + to_string(frame_number) +": " + e.what());
-            continue; // skip curr frame and continue
+        int skip = next_index - source_index;
+        if (skip > seek_threshold){
+            cap.set(CAP_PROP_POS_FRAMES, next_index);
+        } else {
+            // grab() demuxes/decodes without the color conversion and copy of read()
+            for (int i = 0; i < skip && cap.grab(); i++){}
         }
-        
-        // Press 'q' to exit the display window
-        if (waitKey(1) == 'q') {
-            break;
+        source_index = next_index + 1;
+        next_index += range.stride;
+
+        if (!cap.read(out)) {
+            LOG_INFO("End of video reached");
+            return false;
         }
-    }
+        return true;
+    };
+    PreviewWindow display("Frame", opts.display_hz);
+    unique_ptr<TelemetryHud> hud(opts.hud ? new TelemetryHud() : nullptr);
+    FrameStages stages(Size(frame_width, frame_height), opts, cache, &motion_gate, hud.get(), &sinks);
+    auto total_start_time = high_resolution_clock::now();
+    int frame_number = runFramePipeline([&](PipelineFrame& task){ return readFrame(task.frame); },
+                                        [&](PipelineFrame& task){
+                                            sinks.push(task.output);
+                                            pushBev(bev_sinks, task, opts);
+                                            return true;
+                                        },
+                                        stages, perf_tracker, display, fps, opts);
     // Calculate total processing time
     auto total_end_time = high_resolution_clock::now();
     double total_processing_seconds = duration_cast<milliseconds>(total_end_time - total_start_time).count() / 1000.0;
 
     // Release video objects and close windows
     cap.release();
-    out.release();
-    destroyAllWindows();
+    sinks.close();
+    bev_sinks.close();
+    display.close();
     
     // Log final perf summary
     LOG_INFO("=== Processing completed ===");
@@ -424,11 +957,620 @@ int processVideo(const string& input_video_path, const string& output_video_path
     LOG_INFO("Video saved as: " + output_video_path);
 
     perf_tracker.logSummary();
+    sinks.logSummary();
+    bev_sinks.logSummary();
+    budget.logSummary();
+    if (hud){
+        hud->logSummary();
+    }
+    motion_gate.logSummary("video");
+    cache.logSummary();
+    return 0;
+}
+// Options the specialized loop doesn't implement; empty when the run fits it
+string staticPipelineConflict(const RunOptions& opts){
+    if (opts.ipm.metric || opts.ipm.mip_levels > 0 || opts.bev_levels > 0){
+        return "metric / mip / pyramid IPM";
+    }
+    if (opts.reuse_threshold > 0 || !opts.cache_dir.empty()){
+        return "BEV reuse and caching";
+    }
+    if (!opts.preview.empty() || !opts.thumbnails.empty() || !opts.shm.empty() || !opts.bev_output.empty()){
+        return "extra outputs";
+    }
+    if (!opts.range.isFull()){
+        return "frame ranges";
+    }
+    if (opts.pipeline){
+        return "--pipeline";
+    }
+    if (opts.hud){
+        return "--hud";
+    }
+    return "";
+}
+// Video mode with the fixed configuration (heuristic bilinear IPM, PIP, one MP4) through the
+// compile-time Pipeline: same output as processVideo() without the display window
+int processVideoStatic(const string& input_video_path, const string& output_video_path, int frame_width = 1280, int frame_height = 800,
+                       const RunOptions& opts = RunOptions()){
+    LOG_INFO("=== IPM Video Processing Started (static pipeline) ===");
+    LOG_INFO("Input Video: " + input_video_path);
+    LOG_INFO("Output Video: " + output_video_path);
+    Size frame_size(frame_width, frame_height);
+
+    CaptureSource source(input_video_path);
+    if (!source.isOpened()){
+        LOG_ERROR("Unable to open video file:" + input_video_path);
+        return -1;
+    }
+    VideoWriterSink sink(output_video_path, source.fps(), frame_size);
+    if (!sink.isOpened()){
+        LOG_ERROR("Failed to open video writer: " + output_video_path);
+        return -1;
+    }
+    HomographyWarper warper(opts.ipm, frame_size);
+    PipCompositor<> compositor;
+    Pipeline<CaptureSource, HomographyWarper, PipCompositor<>, VideoWriterSink> pipeline(source, warper, compositor, sink, frame_size);
+
+    auto total_start_time = high_resolution_clock::now();
+    long long frames = pipeline.run();
+    double total_processing_seconds = duration_cast<milliseconds>(high_resolution_clock::now() - total_start_time).count() / 1000.0;
+
+    LOG_INFO("=== Processing completed ===");
+    LOG_INFO("Total processing time: " + to_string(total_processing_seconds) + " seconds");
+    LOG_INFO("Average Processing speed: " + to_string(frames / max(total_processing_seconds, 1e-3)) + " fps");
+    LOG_INFO("Video saved as: " + output_video_path);
+    pipeline.stats().log("Static pipeline");
+    return 0;
+}
+// Stream mode coroutines: reader -> processor -> writer per stream, connected by short
+// channels. The reader and writer wait on the pipe / socket in the IoLoop, the processor
+// hands each frame to the FairScheduler, so reading, warping and writing overlap and any
+// number of streams share one pool without a thread per stream.
+// Frames are raw BGR24 (ffmpeg -f rawvideo -pix_fmt bgr24).
+struct StreamFrame {
+    Mat frame;
+    steady_clock::time_point read_at;       // FairScheduler's clock, latency targets count from here
+};
+Task<void> readRawFrames(AsyncStream& in, Size size, FairScheduler& scheduler, int stream, AsyncChannel<StreamFrame>& frames){
+    while (true){
+        Mat frame(size, CV_8UC3);
+        if (!co_await in.readExact(frame.data, frame.total() * frame.elemSize())){
+            break;
+        }
+        scheduler.frameRead(stream);
+        if (!co_await frames.push(StreamFrame{frame, steady_clock::now()})){
+            break;
+        }
+    }
+    frames.close();
+}
+// One frame of a stream is processed at a time: the motion gate and the reused BEV in
+// FrameProcessor need the frames in order, so a single stream keeps one worker busy and
+// the pool is filled by running several streams.
+Task<void> processFrames(FairScheduler& scheduler, int stream, FrameProcessor& processor, PerformanceTracker& perf_tracker,
+                         AsyncChannel<StreamFrame>& frames, AsyncChannel<StreamFrame>& outputs){
+    while (optional<StreamFrame> frame = co_await frames.pop()){
+        auto frame_start_time = high_resolution_clock::now();
+        double ipm_time = 0, pip_time = 0;
+        Mat output;
+        // false: dropped to stay within the stream's latency target
+        if (!co_await scheduler.run(stream, frame->read_at, [&]{ output = processor.process(frame->frame, ipm_time, pip_time); })){
+            continue;
+        }
+        double total_frame_time = duration_cast<microseconds>(high_resolution_clock::now() - frame_start_time).count() / 1000.0;
+        perf_tracker.updateFrameStats(total_frame_time, ipm_time, pip_time);
+        if (!co_await outputs.push(StreamFrame{output, frame->read_at})){
+            break;
+        }
+    }
+    // a failed writer closes outputs, which stops the reader from here
+    frames.close();
+    outputs.close();
+}
+Task<void> writeRawFrames(AsyncStream& out, FairScheduler& scheduler, int stream, AsyncChannel<StreamFrame>& outputs, double stats_every){
+    while (optional<StreamFrame> frame = co_await outputs.pop()){
+        if (!co_await out.writeAll(frame->frame.data, frame->frame.total() * frame->frame.elemSize())){
+            break;
+        }
+        scheduler.frameWritten(stream, duration_cast<microseconds>(steady_clock::now() - frame->read_at).count() / 1000.0);
+        scheduler.maybeReport(stats_every);
+    }
+    outputs.close();
+}
+// One stream of serve mode
+struct StreamSpec {
+    string name;
+    string input;                   // "-", a file / FIFO, tcp:host:port or unix:path
+    string output;
+    Size input_size;
+    double weight = 1;              // share of the workers while streams compete
+    double target_ms = 0;           // read-to-write latency target, frames are dropped to keep it, 0 = none
+};
+// Stream list for serve mode, one stream per line:
+//   <name> <input> <output> <width>x<height> [weight] [target_ms]
+// blank lines and lines starting with # are skipped
+bool loadStreamSpecs(const string& path, vector<StreamSpec>& specs){
+    ifstream file(path);
+    if (!file.is_open()){
+        LOG_ERROR("Cannot open stream list: " + path);
+        return false;
+    }
+    string line;
+    for (int number = 1; getline(file, line); number++){
+        istringstream fields(line);
+        StreamSpec spec;
+        string size;
+        if (!(fields >> spec.name) || spec.name[0] == '#'){
+            continue;
+        }
+        size_t x = string::npos;
+        if (fields >> spec.input >> spec.output >> size){
+            x = size.find('x');
+        }
+        if (x == string::npos){
+            LOG_ERROR(path + ":" + to_string(number) + ": expected <name> <input> <output> <width>x<height> [weight] [target_ms]");
+            return false;
+        }
+        spec.input_size = Size(atoi(size.c_str()), atoi(size.c_str() + x + 1));
+        fields >> spec.weight >> spec.target_ms;
+        if (spec.input_size.area() <= 0){
+            LOG_ERROR(path + ":" + to_string(number) + ": invalid frame size " + size);
+            return false;
+        }
+        specs.push_back(spec);
+    }
+    if (specs.empty()){
+        LOG_ERROR("No streams in " + path);
+        return false;
+    }
+    return true;
+}
+// Everything one stream owns while it runs
+struct StreamState {
+    StreamSpec spec;
+    int id;
+    AsyncStream in;
+    AsyncStream out;
+    FrameProcessor processor;
+    PerformanceTracker perf_tracker;
+    AsyncChannel<StreamFrame> frames;
+    AsyncChannel<StreamFrame> outputs;
+    StreamState(const StreamSpec& spec, int id, IoLoop& loop, Size frame_size, ResultCache& cache, const RunOptions& opts)
+        : spec(spec), id(id), in(loop), out(loop), processor(frame_size, cache, opts), frames(loop, 2), outputs(loop, 2){}
+};
+// All streams on one IoLoop and one worker pool. The IPM maps are per worker thread and the
+// result cache is shared, so N streams cost one set of maps per worker instead of N
+// processes each with their own maps and OpenCV thread pool. Streams that fail to open are
+// skipped; a stream that ends or fails doesn't stop the others.
+int runStreams(const vector<StreamSpec>& specs, int frame_width, int frame_height, const RunOptions& opts){
+    // a reader that goes away shows up as EPIPE on the write
+    signal(SIGPIPE, SIG_IGN);
+    WorkStealingPool pool(workerThreads(opts));
+    IoLoop loop(pool);
+    FairScheduler scheduler(loop, pool.threads());
+    ResultCache cache(opts.cache_dir);
+    const Size frame_size(frame_width, frame_height);
+    vector<unique_ptr<StreamState>> streams;
+    for (const StreamSpec& spec : specs){
+        unique_ptr<StreamState> stream(new StreamState(spec, -1, loop, frame_size, cache, opts));
+        if (!stream->in.open(spec.input, false) || !stream->out.open(spec.output, true)){
+            LOG_ERROR("Skipping stream " + spec.name);
+            continue;
+        }
+        // only streams that opened get a scheduler slot (and a line in its reports)
+        stream->id = scheduler.addStream(spec.name, spec.weight, spec.target_ms);
+        LOG_INFO("Stream " + spec.name + ": " + spec.input + " (" + to_string(spec.input_size.width) + "x" + to_string(spec.input_size.height) +
+                 ") -> " + spec.output + ", weight " + to_string(spec.weight) +
+                 (spec.target_ms > 0 ? ", target " + to_string(spec.target_ms) + "ms" : ""));
+        streams.push_back(move(stream));
+    }
+    if (streams.empty()){
+        return -1;
+    }
+    // OpenCV's own threads would compete with the pool for the same cores
+    if (pool.threads() > 1){
+        setNumThreads(1);
+    }
+
+    auto total_start_time = high_resolution_clock::now();
+    for (auto& stream : streams){
+        loop.spawn(readRawFrames(stream->in, stream->spec.input_size, scheduler, stream->id, stream->frames));
+        loop.spawn(processFrames(scheduler, stream->id, stream->processor, stream->perf_tracker, stream->frames, stream->outputs));
+        loop.spawn(writeRawFrames(stream->out, scheduler, stream->id, stream->outputs, opts.stats_every));
+    }
+    loop.run();
+    double total_processing_seconds = duration_cast<milliseconds>(high_resolution_clock::now() - total_start_time).count() / 1000.0;
+
+    LOG_INFO("=== Stream Processing Completed in " + to_string(total_processing_seconds) + " seconds ===");
+    scheduler.logSummary("Streams");
+    for (auto& stream : streams){
+        LOG_INFO("--- " + stream->spec.name + " ---");
+        stream->perf_tracker.logSummary();
+        stream->processor.logSummary(stream->spec.name);
+    }
+    cache.logSummary();
+    return 0;
+}
+// Raw frames in, composited raw frames out. Each side is "-", a file / FIFO, tcp:host:port or
+// unix:path, e.g.
+//   ffmpeg -i in.mp4 -f rawvideo -pix_fmt bgr24 - | main stream - - --input-size=1920x1080 |
+//   ffmpeg -f rawvideo -pix_fmt bgr24 -s 1280x800 -r 30 -i - out.mp4
+int processStream(const string& input, const string& output, int frame_width = 1280, int frame_height = 800,
+                  const RunOptions& opts = RunOptions()){
+    LOG_INFO("=== IPM Stream Processing Started ===");
+    LOG_INFO("Input: " + input + ", output: " + output + " (raw bgr24 " + to_string(frame_width) + "x" + to_string(frame_height) + ")");
+    if (opts.input_size.area() <= 0){
+        LOG_ERROR("Stream mode needs the input frame size: --input-size=<width>x<height>");
+        return -1;
+    }
+    StreamSpec spec;
+    spec.name = "stream";
+    spec.input = input;
+    spec.output = output;
+    spec.input_size = opts.input_size;
+    return runStreams({spec}, frame_width, frame_height, opts);
+}
+// JPEG / PNG signature check on a record payload
+bool isEncodedImage(const ByteView& bytes){
+    const unsigned char jpeg[] = {0xFF, 0xD8, 0xFF};
+    const unsigned char png[] = {0x89, 'P', 'N', 'G'};
+    return (bytes.size >= 3 && memcmp(bytes.data, jpeg, 3) == 0) ||
+           (bytes.size >= 4 && memcmp(bytes.data, png, 4) == 0);
+}
+// TFRecord inputs: a file, a comma separated list, or every *.tfrecord file in a directory
+vector<string> getTFRecordFiles(const string& input){
+    vector<string> files;
+    try {
+        if (fs::is_directory(input)){
+            for (const auto& entry : fs::directory_iterator(input)){
+                if (entry.is_regular_file() && entry.path().string().find(".tfrecord") != string::npos){
+                    files.push_back(entry.path().string());
+                }
+            }
+            sort(files.begin(), files.end());
+        } else {
+            stringstream list(input);
+            string item;
+            while (getline(list, item, ',')){
+                if (!item.empty()) files.push_back(item);
+            }
+        }
+    } catch(const exception& e){
+        LOG_ERROR("Error listing TFRecord input " + input + ": " + string(e.what()));
+    }
+    LOG_INFO("Found " + to_string(files.size()) + " TFRecord files in: " + input);
+    return files;
+}
+// Process TFRecord containers of encoded images (waymo_extractor.py --pack) or Waymo segment
+// files, whose Frame records are walked lazily for the --camera image. Files are memory-mapped
+// and read by parallel reader threads that decode each JPEG straight from the mapping. With
+// several input files the output path is a directory that gets one video per input, the
+// records of each file stay in order.
+// With --lidar the camera is warped with its calibration onto the metric grid and the lidar
+// range images are turned into points and binned into the same grid on the reader threads,
+// overlapping with the camera warp of the previous frame. --accumulate stitches the
+// calibrated BEVs into a rolling world-aligned map using the frame poses.
+int processTFRecord(const string& input_path, const string& output_video_path, double fps = 30.0,
+                    int frame_width = 1280, int frame_height = 800, const RunOptions& opts = RunOptions()){
+    LOG_INFO("=== TFRecord Processing Started ===");
+    LOG_INFO("Input TFRecord: " + input_path);
+    LOG_INFO("Output Video: " + output_video_path);
+
+    int camera = waymoCameraByName(opts.camera);
+    if (camera < 0){
+        LOG_ERROR("Unknown camera: " + opts.camera + " (FRONT, FRONT_LEFT, FRONT_RIGHT, SIDE_LEFT, SIDE_RIGHT)");
+        return -1;
+    }
+    vector<string> files = getTFRecordFiles(input_path);
+    if (files.empty()){
+        LOG_ERROR("No TFRecord files found: " + input_path);
+        return -1;
+    }
+    bool per_file_output = files.size() > 1;
+    if (per_file_output){
+        error_code ec;
+        fs::create_directories(output_video_path, ec);
+    }
+    PerformanceTracker perf_tracker;
+    ResultCache cache(opts.cache_dir);
+    uint64_t config_hash = opts.ipm.hash();
+    // per input file: writer and motion gate (consecutive frames of different files are unrelated)
+    map<size_t, VideoWriter> writers;
+    map<size_t, MotionGate> gates;
+    map<size_t, bool> gated;
+    map<size_t, shared_ptr<const IPMModel>> models;
+    map<size_t, Mat> previous_bev;
+    map<size_t, BevMap> bev_maps;
+
+    // runs on the reader threads: zero-copy decode from the mapping, resize, content hash
+    atomic<int> skipped_records(0);
+    atomic<int> waymo_frames(0);
+    atomic<long long> lidar_points(0);
+    auto decodeRecord = [&](const ByteView& record, size_t, int record_index, RecordFrame& item) -> bool {
+        ByteView jpeg = record;
+        if (!isEncodedImage(record)){
+            // Waymo Frame: only the camera image is located, lasers and labels are skipped over
+            WaymoFrame waymo;
+            const ByteView* image = nullptr;
+            if (parseWaymoFrame(record, waymo, waymoCameraBit(camera), opts.lidar)){
+                image = waymo.image(camera);
+            }
+            if (!image){
+                skipped_records++;
+                return false;
+            }
+            jpeg = *image;
+            waymo_frames++;
+            const WaymoCameraCalibration* calibration = waymo.calibration(camera);
+            if ((opts.lidar || opts.accumulate > 0 || opts.grid_set) && calibration){
+                item.calibrated = true;
+                item.calibration = *calibration;
+                copy(waymo.pose, waymo.pose + 16, item.pose);
+            }
+            if (opts.lidar && calibration){
+                // per reader thread scratch buffers, reused across frames
+                thread_local LidarPoints points;
+                thread_local vector<unsigned char> scratch;
+                thread_local vector<int> cells;
+                points.clear();
+                waymoLidarPoints(waymo, points, scratch);
+                binLidarPoints(points, opts.ipm.grid, item.lidar, cells);
+                lidar_points += item.lidar.points;
+            }
+        }
+        Mat encoded(1, static_cast<int>(jpeg.size), CV_8UC1, const_cast<unsigned char*>(jpeg.data));
+        item.frame = imdecode(encoded, IMREAD_COLOR);
+        if (item.frame.empty()){
+            LOG_WARNING("Failed to decode record " + to_string(record_index) + " - skipping");
+            return false;
+        }
+        resize(item.frame, item.frame, Size(frame_width, frame_height));
+        item.record_index = record_index;
+        if (cache.enabled()){
+            item.content_hash = hashBytes(jpeg.data, jpeg.size);
+        }
+        return true;
+    };
+    // decoded records waiting in the reader queues count against the memory budget; the IPM
+    // maps and stitched map of each file are reserved once the file's first frame comes in
+    MemoryBudget budget(size_t(max(0, opts.memory_mb)) << 20);
+    budget.reserve("in flight", inFlightBytes(pipelineThreads(opts), Size(frame_width, frame_height)));
+    if (!checkFixedMemory(budget)){
+        return -1;
+    }
+    atomic<bool> budget_warned(false);
+    auto reserveFileMemory = [&](const string& name, size_t bytes){
+        budget.reserve(name, bytes);
+        if (!budget.fixedFits() && !budget_warned.exchange(true)){
+            LOG_WARNING("IPM and stitched maps of the open files take " + to_string(budget.fixed() >> 20) + " MB, more than --memory-mb=" +
+                        to_string(opts.memory_mb) + ": decoded records now queue one at a time");
+        }
+    };
+    auto recordBytes = [](const RecordFrame& item) -> size_t {
+        return item.frame.total() * item.frame.elemSize() + item.lidar.max_height.total() * 4 + item.lidar.density.total() * 4;
+    };
+    TFRecordSource<RecordFrame> source(files, decodeRecord, opts.cycle_length, opts.block_length, opts.range, fps, 4,
+                                       &budget, recordBytes);
+
+    PreviewWindow display("Frame", opts.display_hz);
+    unique_ptr<TelemetryHud> hud(opts.hud ? new TelemetryHud() : nullptr);
+    // composites the BEV of the per-file stage below, the motion gates are per file too
+    FrameStages stages(Size(frame_width, frame_height), opts, cache, nullptr, hud.get());
+    WorkStealingPool pool(pipelineThreads(opts));
+    StageGraph<PipelineFrame> graph(pool);
+    int workers = pool.threads();
+
+    // The per-file state is split between two ordered stages so the warp between them can run
+    // on all workers: "gate" owns the motion gates and the IPM models (shared read-only with
+    // the frames in flight, a new calibration gets a new model), "bev" owns the previous BEVs
+    // and the stitched maps. A failed warp is reported back to the gate of its file.
+    mutex failed_lock;
+    set<size_t> failed_files;
+    auto warpRecord = [&](PipelineFrame& task){
+        auto ipm_start = high_resolution_clock::now();
+        if (task.model){
+            // calibrated warp onto the lidar grid (the cache only holds heuristic IPM results)
+            task.bev = task.model->warp(task.frame);
+        } else {
+            CacheKey key;
+            if (cache.enabled()){
+                key = {task.content_hash, config_hash, Size(frame_width, frame_height)};
+            }
+            task.bev = cachedIPM(task.frame, cache, key, opts.ipm);
+        }
+        task.ipm_ms = duration_cast<microseconds>(high_resolution_clock::now() - ipm_start).count() / 1000.0;
+    };
+    int gate = graph.addStage("gate", [&](PipelineFrame& task){
+        // files that are done: their last frame came through before this one
+        for (size_t done : task.finished){
+            gates.erase(done);
+            gated.erase(done);
+            models.erase(done);
+            budget.reserve("ipm maps " + to_string(done), 0);
+        }
+        MotionGate& motion_gate = gates.try_emplace(task.file_index, opts.reuse_threshold, opts.max_stale_frames).first->second;
+        {
+            lock_guard<mutex> lock(failed_lock);
+            if (failed_files.erase(task.file_index)){
+                motion_gate.invalidate();
+            }
+        }
+        if (task.record.calibrated){
+            auto created_model = models.try_emplace(task.file_index);
+            shared_ptr<const IPMModel>& model = created_model.first->second;
+            Size size = task.frame.size();
+            if (!model || !model->configuredFor(task.record.calibration, opts.ipm.grid, size, opts.ipm.mip_levels)){
+                auto configured = make_shared<IPMModel>();
+                configured->configure(task.record.calibration, opts.ipm.grid, size, opts.ipm.mip_levels);
+                model = configured;
+            }
+            // the grid sets the size of the maps, a new calibration later in the file keeps it
+            if (created_model.second){
+                reserveFileMemory("ipm maps " + to_string(task.file_index), model->mapBytes());
+            }
+            task.model = model;
+        }
+        bool& have_bev = gated[task.file_index];
+        task.reuse = motion_gate.reuse(task.frame) && have_bev;
+        have_bev = true;
+        return true;
+    }, 1, true);
+    int ipm = graph.addStage("ipm", [&](PipelineFrame& task){
+        if (!task.reuse){
+            warpRecord(task);
+        }
+        return true;
+    }, workers);
+    int bev_stage = graph.addStage("bev", [&](PipelineFrame& task){
+        for (size_t done : task.finished){
+            previous_bev.erase(done);
+            bev_maps.erase(done);
+            budget.reserve("bev map " + to_string(done), 0);
+        }
+        Mat& bev = previous_bev[task.file_index];
+        // frames gated before a failed warp was seen have nothing to reuse
+        if (task.reuse && bev.empty()){
+            task.reuse = false;
+            warpRecord(task);
+        }
+        if (!task.reuse){
+            // an empty BEV (calibrated) or the input (heuristic IPM) back: the warp failed
+            if (task.bev.empty() || task.bev.data == task.frame.data){
+                {
+                    lock_guard<mutex> lock(failed_lock);
+                    failed_files.insert(task.file_index);
+                }
+                if (!task.model){
+                    bev.release();
+                    return true;
+                }
+                // keep the previous BEV (the input until there is one) and warp the next frame
+                LOG_WARNING("IPM failed for " + task.name + ", keeping the previous BEV");
+                task.bev = bev.empty() ? task.frame : bev;
+                task.model.reset();
+                return true;
+            }
+            bev = task.bev;
+        }
+        // reuse is resolved per file here, composite() takes task.bev as it is
+        task.reuse = false;
+        if (task.model){
+            const RecordFrame& record = task.record;
+            if (opts.accumulate > 0){
+                auto created_map = bev_maps.try_emplace(task.file_index, opts.ipm.grid, opts.accumulate);
+                BevMap& bev_map = created_map.first->second;
+                if (created_map.second){
+                    reserveFileMemory("bev map " + to_string(task.file_index), bev_map.bytes());
+                }
+                bev_map.accumulate(bev, task.model->validMask(), record.pose);
+                // at the size of the picture-in-picture, a fresh Mat as the previous frame may
+                // still be compositing
+                task.bev = bev_map.render(frame_height / 3);
+            } else {
+                task.bev = bev.clone();
+                if (opts.lidar){
+                    drawLidar(task.bev, record.lidar);
+                }
+            }
+            // the last frame holding a replaced model frees its maps
+            task.model.reset();
+        } else {
+            task.bev = bev;
+        }
+        return true;
+    }, 1, true);
+    int composite = graph.addStage("composite", [&](PipelineFrame& task){
+        stages.composite(task);
+        return true;
+    }, 1, true);
+    // one video per input file, opened with its first frame and closed after its last
+    atomic<bool> failed(false);
+    int frames_done = 0;
+    int encode = graph.addStage("encode", [&](PipelineFrame& task){
+        for (size_t done : task.finished){
+            writers.erase(done);
+        }
+        VideoWriter& out = writers[task.file_index];
+        if (!out.isOpened()){
+            string path = output_video_path;
+            if (per_file_output){
+                path = (fs::path(output_video_path) / (fs::path(source.fileName(task.file_index)).stem().string() + "_bev.mp4")).string();
+            }
+            if (!out.open(path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, Size(frame_width, frame_height))){
+                LOG_ERROR("Unable to create output video file: " + path);
+                failed = true;
+                return false;
+            }
+        }
+        out.write(task.output);
+        recordFrame(perf_tracker, task, ++frames_done, fps, workers);
+        return true;
+    }, 1, true);
+    int display_stage = graph.addStage("display", [&](PipelineFrame& task){
+        display.show(task.output);
+        return true;
+    }, 1, true);
+    graph.connect(gate, ipm);
+    graph.connect(ipm, bev_stage);
+    graph.connect(bev_stage, composite);
+    graph.connect(composite, encode);
+    graph.connect(composite, display_stage);
+
+    // records arrive decoded and resized from the reader threads
+    int frame_number = 0;
+    auto read = [&](PipelineFrame& task){
+        task.start = high_resolution_clock::now();
+        if (!source.next(task.record, task.file_index)){
+            return false;
+        }
+        task.frame = task.record.frame;
+        task.content_hash = task.record.content_hash;
+        task.name = source.fileName(task.file_index) + " record " + to_string(task.record.record_index);
+        source.takeFinished(task.finished);
+        frame_number++;
+        return true;
+    };
+    auto total_start_time = high_resolution_clock::now();
+    graph.run(read, workers + 2, [&]{ return !display.cancelled() && !failed; });
+    graph.logSummary("TFRecord");
+    if (failed){
+        return -1;
+    }
+    auto total_end_time = high_resolution_clock::now();
+    double total_processing_seconds = duration_cast<milliseconds>(total_end_time - total_start_time).count() / 1000.0;
+
+    for (auto& entry : gates){
+        entry.second.logSummary(fs::path(source.fileName(entry.first)).filename().string());
+    }
+    writers.clear();
+    display.close();
+
+    if (waymo_frames > 0){
+        LOG_INFO("Read " + opts.camera + " images from " + to_string(waymo_frames.load()) + " Waymo frames");
+    }
+    if (opts.lidar){
+        LOG_INFO("Lidar: " + to_string(lidar_points.load()) + " points binned into " + opts.ipm.grid.describe());
+    }
+    if (skipped_records > 0){
+        LOG_WARNING("Skipped " + to_string(skipped_records.load()) + " records without an " + opts.camera + " image");
+    }
+    LOG_INFO("=== TFRecord Processing Completed ===");
+    LOG_INFO("Total processing time: " + to_string(total_processing_seconds) + " seconds");
+    LOG_INFO("Average processing speed: " + to_string(frame_number / total_processing_seconds) + " fps");
+    LOG_INFO("Video saved as: " + output_video_path);
+
+    perf_tracker.logSummary();
+    budget.logSummary();
+    LOG_INFO("Stalls: readers waited " + to_string(static_cast<int>(source.readerStallMs())) + "ms on full queues, processing waited " +
+             to_string(static_cast<int>(source.consumerWaitMs())) + "ms for decoded records");
+    cache.logSummary();
     return 0;
 }
 // Process three synchronized camera sequences
 int processThreeCameras(const string& front_dir, const string& front_left_dir, const string& front_right_dir,
-                        const string& output_video = "outputCombineThree.mp4", double fps = 30.0, int width = 1280, int height = 800){
+                        const string& output_video = "outputCombineThree.mp4", double fps = 30.0, int width = 1280, int height = 800,
+                        const RunOptions& opts = RunOptions()){
     // get images from all three directories
     vector<string> front_files = getImageFiles(front_dir);
     vector<string> front_left_files = getImageFiles(front_left_dir);
@@ -441,7 +1583,9 @@ int processThreeCameras(const string& front_dir, const string& front_left_dir, c
     }
     // frame count: use the smallest frame count
     int frame_count = min({front_files.size(), front_left_files.size(), front_right_files.size()});
-    LOG_INFO("Processing " + to_string(frame_count) + " synced frames...");
+    // Frame range on the synced index, skipped frames are never read
+    FrameRange range = opts.range.resolve(fps, frame_count);
+    LOG_INFO("Processing " + to_string(range.count()) + " synced frames...");
 
     //initialize video writer
     VideoWriter writer(output_video, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, Size(width, height));
@@ -450,119 +1594,366 @@ int processThreeCameras(const string& front_dir, const string& front_left_dir, c
         return -1;
     }
     
-    auto total_start_time = high_resolution_clock::now();
+    // one gate per camera, each camera keeps its own previous BEV
+    MotionGate gate_front(opts.reuse_threshold, opts.max_stale_frames);
+    MotionGate gate_front_left(opts.reuse_threshold, opts.max_stale_frames);
+    MotionGate gate_front_right(opts.reuse_threshold, opts.max_stale_frames);
+    ResultCache cache(opts.cache_dir);
+    uint64_t config_hash = opts.ipm.hash();
 
-    // Process Each frame
-    for(int i = 0; i < frame_count; i++){
-        auto frame_start_time = high_resolution_clock::now();
-        try {
-            Mat front = imread(front_files[i]);
-            Mat front_left = imread(front_left_files[i]);
-            Mat front_right = imread(front_right_files[i]);
-
-            // skip if any image failed to load
-            if (front.empty() || front_left.empty() || front_right.empty()) continue;
-
-            // Combine three cameras into single view
-            int single_cam_width = width * 0.65;
-            int single_cam_height = height * 0.65;
-
-            //resize all cameras to same dimensions
-            Mat front_resized, front_left_resized, front_right_resized;
-            resize(front, front_resized, Size(single_cam_width, single_cam_height));
-            resize(front_left, front_left_resized, Size(single_cam_width, single_cam_height));
-            resize(front_right, front_right_resized, Size(single_cam_width, single_cam_height));
-
-            // create combined image has correct dimensions
-            Mat combined;
-            vector<Mat> cameras = {front_left_resized, front_resized, front_right_resized};
-            hconcat(cameras, combined);
-            // Apply
-            Mat IPM_front = IPM(front);
-            Mat IPM_front_left = IPM(front_left);
-            Mat IPM_front_right = IPM(front_right);
-            Mat final_frame;
-            vector<Mat> IPM_combined = {IPM_front_left, IPM_front, IPM_front_right};
-            hconcat(IPM_combined, final_frame);
-
-            //resized frame
-            Mat resized_frame;
-            resize(final_frame, resized_frame, Size(width, height));
-            writer.write(resized_frame);
-            imshow("Three Camera View", resized_frame);
-            if (waitKey(1) == 'q') break;
+    // Prefetch each camera's selected images ahead of processing
+    vector<string> front_selected = range.select(front_files);
+    vector<string> front_left_selected = range.select(front_left_files);
+    vector<string> front_right_selected = range.select(front_right_files);
+    // (--prefetch-mb=0 leaves only the current file in flight)
+    size_t prefetch_bytes = (size_t(max(opts.prefetch_mb, 0)) << 20) / 3;
+    size_t prefetch_files = opts.prefetch_mb > 0 ? 16 : 1;
+    AsyncFileReader front_reader(front_selected, prefetch_bytes, prefetch_files);
+    AsyncFileReader front_left_reader(front_left_selected, prefetch_bytes, prefetch_files);
+    AsyncFileReader front_right_reader(front_right_selected, prefetch_bytes, prefetch_files);
 
-        } catch(const exception& e){
-            LOG_ERROR("Error processing frame "+ to_string(i) + ": " + string(e.what()));
-            continue;
+    // Cameras are warped at source resolution, so the cache key has no geometry. Without
+    // the motion gate a cache hit skips both decode and warp.
+    auto cameraKey = [&](const vector<uchar>& bytes) -> CacheKey {
+        return {hashBytes(bytes.data(), bytes.size()), config_hash, Size()};
+    };
+
+    PreviewWindow display("Three Camera View", opts.display_hz);
+    PerformanceTracker perf_tracker;
+    WorkStealingPool pool(pipelineThreads(opts));
+    StageGraph<PipelineFrame> graph(pool);
+    int workers = pool.threads();
+
+    // per camera: decode and warp on all workers, the gate in between runs in frame order;
+    // the previous BEV of each camera is handed over in the ordered combine stage, which
+    // also tells the gate about a failed warp
+    const char* camera_names[3] = {"front_left", "front", "front_right"};
+    MotionGate* gates[3] = {&gate_front_left, &gate_front, &gate_front_right};
+    bool have_bev[3] = {false, false, false};
+    atomic<bool> warp_failed[3] = {false, false, false};
+    Mat previous_bev[3];
+    int cameras[3];
+    auto warpView = [&](PipelineFrame& task, int c){
+        auto ipm_start = high_resolution_clock::now();
+        CacheKey key;
+        if (cache.enabled()){
+            key = cameraKey(task.views[c]);
+        }
+        task.view_bevs[c] = cachedIPM(task.view_frames[c], cache, key, opts.ipm, gates[c]->enabled());
+        task.views[c] = vector<uchar>();
+        task.view_ms[c] += duration_cast<microseconds>(high_resolution_clock::now() - ipm_start).count() / 1000.0;
+    };
+    for (int c = 0; c < 3; c++){
+        string name = camera_names[c];
+        int decode = graph.addStage(name + " decode", [&, c](PipelineFrame& task){
+            auto decode_start = high_resolution_clock::now();
+            const vector<uchar>& bytes = task.views[c];
+            if (cache.enabled() && !gates[c]->enabled() && cache.load(cameraKey(bytes), task.view_bevs[c])){
+                task.views[c] = vector<uchar>();
+            } else {
+                task.view_frames[c] = imdecode(bytes, IMREAD_COLOR);
+                if (task.view_frames[c].empty()){
+                    LOG_WARNING("Failed to read " + string(camera_names[c]) + " image of frame " + task.name + " - skipping");
+                    return false;
+                }
+            }
+            task.view_ms[c] = duration_cast<microseconds>(high_resolution_clock::now() - decode_start).count() / 1000.0;
+            return true;
+        }, workers);
+        int gate = graph.addStage(name + " gate", [&, c](PipelineFrame& task){
+            if (!task.view_bevs[c].empty()){
+                return true;
+            }
+            if (warp_failed[c].exchange(false)){
+                gates[c]->invalidate();
+            }
+            task.view_reuse[c] = gates[c]->reuse(task.view_frames[c]) && have_bev[c];
+            have_bev[c] = true;
+            return true;
+        }, 1, true);
+        cameras[c] = graph.addStage(name + " ipm", [&, c](PipelineFrame& task){
+            if (task.view_bevs[c].empty() && !task.view_reuse[c]){
+                warpView(task, c);
+            }
+            return true;
+        }, workers);
+        graph.connect(decode, gate);
+        graph.connect(gate, cameras[c]);
+    }
+    int combine = graph.addStage("combine", [&](PipelineFrame& task){
+        for (int c = 0; c < 3; c++){
+            // frames gated before a failed warp was seen have nothing to reuse
+            if (task.view_reuse[c] && previous_bev[c].empty()){
+                task.view_reuse[c] = false;
+                warpView(task, c);
+            }
+            if (task.view_reuse[c]){
+                task.view_bevs[c] = previous_bev[c];
+            } else if (task.view_bevs[c].data == task.view_frames[c].data){
+                // the input came back: the warp failed, warp the next frame
+                previous_bev[c].release();
+                warp_failed[c] = true;
+            } else {
+                previous_bev[c] = task.view_bevs[c];
+            }
+            task.views[c] = vector<uchar>();
+            task.view_frames[c].release();
         }
+        auto combine_start = high_resolution_clock::now();
+        Mat final_frame;
+        hconcat(task.view_bevs, 3, final_frame);
+        resize(final_frame, task.output, Size(width, height));
+        task.ipm_ms = task.view_ms[0] + task.view_ms[1] + task.view_ms[2];
+        task.pip_ms = duration_cast<microseconds>(high_resolution_clock::now() - combine_start).count() / 1000.0;
+        return true;
+    }, 1, true);
+    int frames_done = 0;
+    int encode = graph.addStage("encode", [&](PipelineFrame& task){
+        writer.write(task.output);
+        recordFrame(perf_tracker, task, ++frames_done, fps, workers);
+        return true;
+    }, 1, true);
+    int display_stage = graph.addStage("display", [&](PipelineFrame& task){
+        display.show(task.output);
+        return true;
+    }, 1, true);
+    for (int c = 0; c < 3; c++){
+        graph.connect(cameras[c], combine);
     }
+    graph.connect(combine, encode);
+    graph.connect(combine, display_stage);
+
+    // all three readers are advanced every frame to stay in sync, a frame with a missing
+    // image is skipped
+    AsyncFileReader* readers[3] = {&front_left_reader, &front_reader, &front_right_reader};
+    int frame_index = range.start;
+    auto read = [&](PipelineFrame& task){
+        for (; frame_index < range.end; frame_index += range.stride){
+            task.start = high_resolution_clock::now();
+            task.name = to_string(frame_index);
+            bool ok = true;
+            for (int c = 0; c < 3; c++){
+                string path;
+                ok = readers[c]->next(path, task.views[c]) && !task.views[c].empty() && ok;
+            }
+            if (ok){
+                frame_index += range.stride;
+                return true;
+            }
+        }
+        return false;
+    };
+    auto total_start_time = high_resolution_clock::now();
+    graph.run(read, workers + 2, [&]{ return !display.cancelled(); });
+    graph.logSummary("Three cameras");
     auto total_end_time = high_resolution_clock::now();
     double total_processing_seconds = duration_cast<milliseconds>(total_end_time - total_start_time).count() / 1000.0;
     
     writer.release();
-    destroyAllWindows();
+    display.close();
 
     // Log Final summary
     LOG_INFO("=== Three Camera Processing Complemeted ===");
     LOG_INFO("Total processing time: " + to_string(total_processing_seconds) + " seconds");
     LOG_INFO("Video saved to: " + output_video);
+    perf_tracker.logSummary();
+    gate_front.logSummary("front");
+    gate_front_left.logSummary("front_left");
+    gate_front_right.logSummary("front_right");
+    cache.logSummary();
     return 0;
 }
 int main(int argc, char* argv[]) {
     // Initialize logger
     g_logger = new Logger("ipm_processing.log");
     
-    // parge cmd line args
-    if (argc < 2) {
+    // parge cmd line args, --options may appear anywhere
+    vector<string> args;
+    RunOptions opts;
+    if (!parseOptions(argc, argv, args, opts)){
+        delete g_logger;
+        return -1;
+    }
+    if (args.size() < 2) {
         LOG_INFO("Usage:");
-        LOG_INFO("  For video input: " + string(argv[0]) + " video <input_video_path> [output_video_path]");
-        LOG_INFO("  For image sequence: " + string(argv[0]) + " images <input_directory> [output_video_path] [fps]");
-        LOG_INFO("For three cameras: " + string(argv[0]) + " three <front_dir> <front_left_dir> <front_right_dir> [output_video_path] [fps]");
+        LOG_INFO("  For video input: " + args[0] + " video <input_video_path> [output_video_path]");
+        LOG_INFO("  For image sequence: " + args[0] + " images <input_directory> [output_video_path] [fps]");
+        LOG_INFO("For three cameras: " + args[0] + " three <front_dir> <front_left_dir> <front_right_dir> [output_video_path] [fps]");
+        LOG_INFO("  For packed images or Waymo segments: " + args[0] + " tfrecord <input.tfrecord|dir|a,b,...> [output_video_path|output_dir] [fps]");
+        LOG_INFO("  For raw bgr24 frame streams: " + args[0] + " stream <input|-|tcp:host:port|unix:path> [output|-] --input-size=<w>x<h>");
+        LOG_INFO("  For many streams on one worker pool: " + args[0] + " serve <streams.txt>  (lines: name input output WxH [weight] [target_ms])");
+        LOG_INFO("    (each stream processes one frame at a time, so a single stream uses one worker; more streams fill more workers)");
+        LOG_INFO("Options:");
+        LOG_INFO("  --reuse-threshold=<diff>  reuse the previous BEV while the frame changes less than <diff> (e.g. 2.0)");
+        LOG_INFO("  --max-stale=<n>           warp at least every <n> frames when reusing (default 15)");
+        LOG_INFO("  --cache-dir=<dir>         content-addressed BEV cache, re-runs skip the warp for unchanged frames");
+        LOG_INFO("  --ipm-param1=<px> --ipm-param2=<px>  IPM parameters (default 570, 35)");
+        LOG_INFO("  --mip-levels=<n>          anti-aliased IPM sampling the far field from an n-level source pyramid (default 0 = off)");
+        LOG_INFO("  --bev-levels=<n>          video/images: also produce the BEV at 1/2 .. 1/2^n resolution in the warp pass (PIP uses the closest)");
+        LOG_INFO("  --preview=<mp4> --preview-width=<px>     video/images: also write a downscaled preview (default 320 px wide)");
+        LOG_INFO("  --thumbnails=<dir> --thumbnail-every=<n> video/images: JPEG thumbnail every n-th frame (default 30)");
+        LOG_INFO("  --thumbnail-width=<px>    width of the thumbnails (default 320)");
+        LOG_INFO("  --shm=<name>              video/images: latest output frame in shared memory /dev/shm/<name>");
+        LOG_INFO("  --bev-output=<mp4>        video/images: also write the BEV alone at its own size (the --calibration grid)");
+        LOG_INFO("  --bev-output-level=<n>    write --bev-levels level n (1/2^n resolution) to --bev-output instead (default 0)");
+        LOG_INFO("  --sink-queue=<n>          frames queued per output before the encoder holds up processing (default 8)");
+        LOG_INFO("  --memory-mb=<MB>          cap on queued frames and fixed buffers, the source waits when it is used up (default off)");
+        LOG_INFO("  --pipeline --threads=<n>  overlap decode, resize and IPM of several frames on n workers (default: one per core)");
+        LOG_INFO("  --hud                     video/images/tfrecord: draw frame number, fps, stage latency and dropped frames into the output");
+        LOG_INFO("  --display-hz=<hz>         preview window refresh on its own thread, 'q' in it stops (default 10, 0 = no window)");
+        LOG_INFO("  --static                  video: loop specialized for the default config (bilinear IPM, PIP, one MP4), no preview window");
+        LOG_INFO("  --input-size=<w>x<h>      stream: size of the raw input frames (output is 1280x800 raw bgr24)");
+        LOG_INFO("  --stats-every=<s>         serve: seconds between per-stream fps / latency / drop reports (default 10, 0 = at the end)");
+        LOG_INFO("  --checkpoint-every=<n>    images mode: write the output in <n>-frame segments with a checkpoint after each");
+        LOG_INFO("  --resume                  images mode: continue from the checkpoint of a previous run");
+        LOG_INFO("  --start=<n> --end=<n> --stride=<n>       process frames [start, end) taking every n-th frame");
+        LOG_INFO("  --start-time=<s> --end-time=<s>          same range in seconds (images: at the given fps)");
+        LOG_INFO("  --watch                   images mode: process files as they are written into the directory");
+        LOG_INFO("  --watch-window=<n> --idle-timeout=<s>    reorder window (default 8) and when to stop watching (default 30s)");
+        LOG_INFO("  --prefetch-mb=<MB>        image bytes read ahead of processing (default 64, 0 = synchronous reads)");
+        LOG_INFO("  --cycle-length=<n> --block-length=<n>    tfrecord: files read in parallel (default 4), records per file per turn (default 1)");
+        LOG_INFO("  --camera=<name>           tfrecord: camera read from Waymo segment files (default FRONT)");
+        LOG_INFO("  --lidar                   tfrecord: calibrated metric BEV with lidar max height / density binned into it");
+        LOG_INFO("  --accumulate=<meters>     tfrecord: stitch calibrated BEVs into a rolling map of this size using the vehicle pose");
+        LOG_INFO("  --calibration=<yml>       video/images: metric BEV from a camera calibration (waymo_extractor.py writes calibration.yml)");
+        LOG_INFO("  --bev-lateral=<m> --bev-forward=<m>      metric BEV width (centered) and depth (default 40, 40)");
+        LOG_INFO("  --bev-forward-min=<m> --bev-resolution=<m/px>  metric BEV near edge (default 0) and cell size (default 0.1)");
         LOG_INFO("Examples:");
-        LOG_INFO("  " + string(argv[0]) + " video ../output_front.mp4");
-        LOG_INFO("  " + string(argv[0]) + " images ./waymo_images/ waymo_output.mp4 30");
-        LOG_INFO(" " + string(argv[0]) + " three ./front ./front_left ./front_right combined_output.mp4 30");
+        LOG_INFO("  " + args[0] + " video ../output_front.mp4");
+        LOG_INFO("  " + args[0] + " images ./waymo_images/ waymo_output.mp4 30");
+        LOG_INFO(" " + args[0] + " three ./front ./front_left ./front_right combined_output.mp4 30");
+        LOG_INFO("  " + args[0] + " images ./waymo_images/ waymo_output.mp4 30 --reuse-threshold=2.0");
+        LOG_INFO("  " + args[0] + " images ./output/front/ front_live.mp4 10 --watch");
+        LOG_INFO("  " + args[0] + " images ./output/front/ front_bev.mp4 10 --calibration=./output/front/calibration.yml --bev-lateral=20 --bev-resolution=0.05");
         delete g_logger;
         return -1;
     }
-    string mode = argv[1];
+    string mode = args[1];
     int result = 0;
+    // without checkpoints there is nothing to resume from, the run would overwrite the output
+    if (opts.resume && (opts.checkpoint_every <= 0 || mode != "images")){
+        LOG_ERROR("--resume continues an images mode run with --checkpoint-every, pass the same --checkpoint-every=<n>");
+        delete g_logger;
+        return -1;
+    }
+    // the BEV output takes its level from the pyramid the warp already produces
+    if (opts.bev_output_level < 0 || opts.bev_output_level > min(opts.bev_levels, 6)){
+        LOG_ERROR("--bev-output-level needs --bev-levels of at least the same level (at most 6)");
+        delete g_logger;
+        return -1;
+    }
+    // checkpoint segments only split the main output, a resumed run would start the preview
+    // and BEV videos over
+    if (opts.checkpoint_every > 0 && (!opts.preview.empty() || !opts.bev_output.empty())){
+        LOG_ERROR("--preview and --bev-output cannot be combined with --checkpoint-every");
+        delete g_logger;
+        return -1;
+    }
+    // stream mode may write frames to stdout
+    if (mode == "stream" && (args.size() < 4 || args[3] == "-")){
+        g_logger->consoleToStderr();
+    }
+    // serve mode: read the stream list first, any stream may write to stdout
+    vector<StreamSpec> serve_specs;
+    if (mode == "serve"){
+        if (args.size() < 3 || !loadStreamSpecs(args[2], serve_specs)){
+            if (args.size() < 3){
+                LOG_ERROR("Stream list required for serve mode");
+            }
+            delete g_logger;
+            return -1;
+        }
+        for (const StreamSpec& spec : serve_specs){
+            if (spec.output == "-"){
+                g_logger->consoleToStderr();
+            }
+        }
+    }
+
+    // metric BEV: the grid sets the output size, so reject grids that cannot be allocated
+    const BevGrid& grid = opts.ipm.grid;
+    if (!(grid.resolution > 0) || !(grid.forward_max > grid.forward_min) || !(grid.lateral_max > grid.lateral_min)
+        || grid.rows() > 8192 || grid.cols() > 8192){
+        LOG_ERROR("Invalid BEV grid: " + grid.describe());
+        delete g_logger;
+        return -1;
+    }
+    if (!opts.calibration_file.empty()){
+        if (!loadCameraCalibration(opts.calibration_file, opts.ipm.calibration)){
+            delete g_logger;
+            return -1;
+        }
+        if (mode == "three"){
+            LOG_WARNING("--calibration describes one camera, three-camera mode keeps the heuristic IPM");
+        } else if (mode != "tfrecord"){
+            opts.ipm.metric = true;
+            LOG_INFO("Metric BEV: " + grid.describe());
+        }
+    } else if (opts.grid_set && mode != "tfrecord"){
+        LOG_WARNING("--bev-* options need --calibration outside tfrecord mode, using the heuristic IPM");
+    }
 
     if (mode == "video"){
-        string input_video_path = (argc > 2) ? argv[2] : "../output_front.mp4";
-        string output_video_path = (argc > 3) ? argv[3] : "carla_BEV_IPM_output_2.mp4";
+        string input_video_path = (args.size() > 2) ? args[2] : "../output_front.mp4";
+        string output_video_path = (args.size() > 3) ? args[3] : "carla_BEV_IPM_output_2.mp4";
 
-        result = processVideo(input_video_path, output_video_path);
+        string conflict = opts.static_pipeline ? staticPipelineConflict(opts) : "";
+        if (opts.static_pipeline && conflict.empty()){
+            result = processVideoStatic(input_video_path, output_video_path, 1280, 800, opts);
+        } else {
+            if (opts.static_pipeline){
+                LOG_WARNING("--static does not cover " + conflict + ", using the general pipeline");
+            }
+            result = processVideo(input_video_path, output_video_path, 1280, 800, opts);
+        }
     } else if(mode == "images"){
         // image seq processing mode
-        if (argc < 3) {
+        if (args.size() < 3) {
             LOG_ERROR("Image directory path required for images mode");
             delete g_logger;
             return -1;
         }
-        string input_dir = argv[2];
-        string output_video_path = (argc > 3) ? argv[3] : "waymo_BEV_IPM_output.mp4";
-        double fps = (argc > 4) ? stod(argv[4]) : 30.0;
+        string input_dir = args[2];
+        string output_video_path = (args.size() > 3) ? args[3] : "waymo_BEV_IPM_output.mp4";
+        double fps = (args.size() > 4) ? stod(args[4]) : 30.0;
 
-        result = processImageSequence(input_dir, output_video_path, fps);
+        result = processImageSequence(input_dir, output_video_path, fps, 1280, 800, opts);
     } else if (mode == "three"){
         // Three Camera Processing mode
-        if (argc < 5){
+        if (args.size() < 5){
             LOG_ERROR("Three directory paths required for three-camera mode: front_dir front_left_dir front_right_dir");
             delete g_logger;
             return -1;
         }
-        string front_dir = argv[2];
-        string front_left_dir = argv[3];
-        string front_right_dir = argv[4];
-        string output_video_path = (argc > 5) ? argv[5] : "outputCombineThree.mp4";
-        double fps = (argc > 6) ? stod(argv[6]) : 30.0;
+        string front_dir = args[2];
+        string front_left_dir = args[3];
+        string front_right_dir = args[4];
+        string output_video_path = (args.size() > 5) ? args[5] : "outputCombineThree.mp4";
+        double fps = (args.size() > 6) ? stod(args[6]) : 30.0;
+
+        result = processThreeCameras(front_dir, front_left_dir, front_right_dir, output_video_path, fps, 1280, 800, opts);
+    } else if (mode == "tfrecord"){
+        // TFRecord container mode
+        if (args.size() < 3){
+            LOG_ERROR("TFRecord file path required for tfrecord mode");
+            delete g_logger;
+            return -1;
+        }
+        string input_path = args[2];
+        string output_video_path = (args.size() > 3) ? args[3] : "tfrecord_BEV_IPM_output.mp4";
+        double fps = (args.size() > 4) ? stod(args[4]) : 30.0;
 
-        result = processThreeCameras(front_dir, front_left_dir, front_right_dir, output_video_path, fps);
+        result = processTFRecord(input_path, output_video_path, fps, 1280, 800, opts);
+    } else if (mode == "stream"){
+        string input = (args.size() > 2) ? args[2] : "-";
+        string output = (args.size() > 3) ? args[3] : "-";
+        result = processStream(input, output, 1280, 800, opts);
+    } else if (mode == "serve"){
+        LOG_INFO("=== IPM Stream Server Started: " + to_string(serve_specs.size()) + " streams from " + args[2] + " ===");
+        result = runStreams(serve_specs, 1280, 800, opts);
     }
     else{
-        LOG_ERROR("Invalid mode: " + mode + ". Use 'video' or 'images' ");
+        LOG_ERROR("Invalid mode: " + mode + ". Use 'video', 'images', 'three', 'tfrecord', 'stream' or 'serve'");
         result = -1;
     }
     //clean up
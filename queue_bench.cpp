@@ -0,0 +1,189 @@
+// Handoff latency / throughput of the frame queues in LockFreeQueue.h against a
+// mutex + condition variable queue. No OpenCV needed:
+//   ./queue_bench [--items=200000] [--pace-us=20] [--threads=4]
+// "paced" sends one item every pace-us from one producer to one consumer (frame handoff,
+// measures wakeup latency); "contended" runs N producers and N consumers flat out.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LockFreeQueue.h"
+using namespace std;
+using namespace std::chrono;
+
+struct Stamp {
+    int64_t sent_ns = 0;
+};
+
+inline int64_t nowNs(){
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// baseline: what the pipeline used so far
+template<typename T>
+class MutexQueue {
+private:
+    deque<T> queue;
+    size_t capacity;
+    mutex mtx;
+    condition_variable not_empty, not_full;
+    bool closed = false;
+public:
+    explicit MutexQueue(size_t capacity) : capacity(capacity){}
+    bool push(T value){
+        unique_lock<mutex> lock(mtx);
+        not_full.wait(lock, [&]{ return closed || queue.size() < capacity; });
+        if (closed){
+            return false;
+        }
+        queue.push_back(move(value));
+        not_empty.notify_one();
+        return true;
+    }
+    bool pop(T& out){
+        unique_lock<mutex> lock(mtx);
+        not_empty.wait(lock, [&]{ return closed || !queue.empty(); });
+        if (queue.empty()){
+            return false;
+        }
+        out = move(queue.front());
+        queue.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+    void close(){
+        lock_guard<mutex> lock(mtx);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+};
+
+struct Result {
+    double p50_us, p99_us, max_us, items_per_s;
+};
+
+template<typename Queue>
+Result run(Queue& queue, int producers, int consumers, int items, int pace_ns){
+    vector<vector<int64_t>> latencies(consumers);
+    vector<thread> threads;
+    int per_producer = items / producers;
+    int64_t start = nowNs();
+    for (int c = 0; c < consumers; c++){
+        latencies[c].reserve(items / consumers + 16);
+        threads.emplace_back([&, c]{
+            Stamp stamp;
+            while (queue.pop(stamp)){
+                latencies[c].push_back(nowNs() - stamp.sent_ns);
+            }
+        });
+    }
+    vector<thread> senders;
+    for (int p = 0; p < producers; p++){
+        senders.emplace_back([&]{
+            auto next = steady_clock::now();
+            for (int i = 0; i < per_producer; i++){
+                if (pace_ns > 0){
+                    // sleep like a frame source would, a busy producer would steal the consumer's core
+                    next += nanoseconds(pace_ns);
+                    this_thread::sleep_until(next);
+                }
+                Stamp stamp;
+                stamp.sent_ns = nowNs();
+                queue.push(stamp);
+            }
+        });
+    }
+    for (auto& t : senders){
+        t.join();
+    }
+    queue.close();
+    for (auto& t : threads){
+        t.join();
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    vector<int64_t> all;
+    for (auto& l : latencies){
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    sort(all.begin(), all.end());
+    Result r;
+    r.p50_us = all.empty() ? 0 : all[all.size() / 2] / 1000.0;
+    r.p99_us = all.empty() ? 0 : all[all.size() * 99 / 100] / 1000.0;
+    r.max_us = all.empty() ? 0 : all.back() / 1000.0;
+    r.items_per_s = all.size() / seconds;
+    return r;
+}
+
+void report(const char* scenario, const string& queue, const Result& r){
+    printf("%-10s %-22s %10.2f %10.2f %10.1f %14.0f\n", scenario, queue.c_str(), r.p50_us, r.p99_us, r.max_us, r.items_per_s);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]){
+    int items = 200000, pace_us = 20, threads = 4;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg.rfind("--items=", 0) == 0){
+            items = atoi(arg.c_str() + 8);
+        } else if (arg.rfind("--pace-us=", 0) == 0){
+            pace_us = atoi(arg.c_str() + 10);
+        } else if (arg.rfind("--threads=", 0) == 0){
+            threads = max(1, atoi(arg.c_str() + 10));
+        } else {
+            fprintf(stderr, "usage: %s [--items=N] [--pace-us=N] [--threads=N]\n", argv[0]);
+            return 1;
+        }
+    }
+    const size_t capacity = 64;
+    // spinning needs a core per spinning thread, on one core it only measures the scheduler
+    vector<WaitStrategy> strategies = {WaitStrategy::Block, WaitStrategy::Hybrid};
+    if (thread::hardware_concurrency() >= 2){
+        strategies.push_back(WaitStrategy::Spin);
+    }
+    printf("%-10s %-22s %10s %10s %10s %14s\n", "scenario", "queue", "p50 us", "p99 us", "max us", "items/s");
+
+    // one item every pace_us, 1 -> 1
+    int paced_items = max(1000, items / 20);
+    {
+        MutexQueue<Stamp> q(capacity);
+        report("paced", "mutex+condvar", run(q, 1, 1, paced_items, pace_us * 1000));
+    }
+    for (WaitStrategy s : strategies){
+        HandoffQueue<Stamp, SpscRing> q(capacity, s, s);
+        report("paced", string("spsc/") + waitStrategyName(s), run(q, 1, 1, paced_items, pace_us * 1000));
+    }
+    for (WaitStrategy s : strategies){
+        HandoffQueue<Stamp, MpmcQueue> q(capacity, s, s);
+        report("paced", string("mpmc/") + waitStrategyName(s), run(q, 1, 1, paced_items, pace_us * 1000));
+    }
+
+    // flat out, 1 -> 1 and N -> N
+    {
+        MutexQueue<Stamp> q(capacity);
+        report("1x1", "mutex+condvar", run(q, 1, 1, items, 0));
+    }
+    for (WaitStrategy s : strategies){
+        HandoffQueue<Stamp, SpscRing> q(capacity, s, s);
+        report("1x1", string("spsc/") + waitStrategyName(s), run(q, 1, 1, items, 0));
+    }
+    string contended = to_string(threads) + "x" + to_string(threads);
+    {
+        MutexQueue<Stamp> q(capacity);
+        report(contended.c_str(), "mutex+condvar", run(q, threads, threads, items, 0));
+    }
+    for (WaitStrategy s : strategies){
+        if (s == WaitStrategy::Spin && 2 * threads > static_cast<int>(thread::hardware_concurrency())){
+            continue;
+        }
+        HandoffQueue<Stamp, MpmcQueue> q(capacity, s, s);
+        report(contended.c_str(), string("mpmc/") + waitStrategyName(s), run(q, threads, threads, items, 0));
+    }
+    return 0;
+}
@@ -12,11 +12,18 @@ python waymo_extractor.py --tfrecord assets/segment-1063302682054393085_705_000_
 # Extract front camera images (good for IPM)
 python waymo_extractor.py --tfrecord assets/segment-10495858009395654700_197_000_217_000.tfrecord --output_dir ./output --camera FRONT
 
+# Extract front camera images plus calibration.yml, then a metric BEV (20m wide at 5cm/px)
+python waymo_extractor.py --tfrecord assets/segment-10495858009395654700_197_000_217_000.tfrecord --output_dir ./output --camera FRONT
+./main images ./output/front/ front_bev.mp4 10 --calibration=./output/front/calibration.yml --bev-lateral=20 --bev-resolution=0.05
+
 # Extract first 50 frames only for testing
 python waymo_extractor.py --tfrecord segment-10330268205439308_705_000_725_000.tfrecord --output_dir ./output --camera FRONT --max_frames 50
 
 # Extract all cameras - default
 python waymo_extractor.py --tfrecord assets/segment-10495858009395654700_197_000_217_000.tfrecord --output_dir ./output --camera ALL
+
+# Pack front camera JPEGs into one TFRecord container for `main tfrecord` (no re-encoding)
+python waymo_extractor.py --tfrecord assets/segment-10495858009395654700_197_000_217_000.tfrecord --output_dir ./output --camera FRONT --pack
 """
 """
 Simplified Waymo Image Extractor based on the official tutorial
@@ -39,6 +46,27 @@ except:
 
 from waymo_open_dataset import dataset_pb2 as open_dataset
 
+def write_camera_calibration(frame, target_camera, camera_output_dir):
+    """
+    Write the camera's intrinsics and extrinsic (camera -> vehicle) as OpenCV YAML to
+    <camera_output_dir>/calibration.yml, for `main images ... --calibration=<file>`
+    """
+    for calib in frame.context.camera_calibrations:
+        if calib.name != target_camera:
+            continue
+        keys = ['f_u', 'f_v', 'c_u', 'c_v', 'k1', 'k2', 'p1', 'p2', 'k3']
+        lines = ['%YAML:1.0', '---']
+        lines += [f"{key}: {value:.10g}" for key, value in zip(keys, calib.intrinsic)]
+        lines += [f"width: {calib.width}", f"height: {calib.height}", f"name: {calib.name}"]
+        lines += ['extrinsic: !!opencv-matrix', '   rows: 4', '   cols: 4', '   dt: d',
+                  '   data: [ ' + ', '.join(f"{value:.10g}" for value in calib.extrinsic.transform) + ' ]']
+        calib_path = os.path.join(camera_output_dir, 'calibration.yml')
+        with open(calib_path, 'w') as f:
+            f.write('\n'.join(lines) + '\n')
+        print(f"  Calibration -> {calib_path}")
+        return True
+    return False
+
 def extract_images_from_single_tfrecord(tfrecord_path, output_base_dir, camera_name='FRONT', max_frames=None):
     """
     Extract images from a single tfrecord file using the tutorial approach
@@ -84,6 +112,8 @@ def extract_images_from_single_tfrecord(tfrecord_path, output_base_dir, camera_n
         # Parse frame (following tutorial approach)
         frame = open_dataset.Frame()
         frame.ParseFromString(bytearray(data.numpy()))
+        if frame_count == 0:
+            write_camera_calibration(frame, target_camera, camera_output_dir)
         
         # Extract images from the frame
         for image in frame.images:
@@ -114,6 +144,32 @@ def extract_images_from_single_tfrecord(tfrecord_path, output_base_dir, camera_n
     print(f"Processed {frame_count} frames, saved {saved_count} images to {camera_output_dir}")
     return saved_count
 
+def pack_images_to_tfrecord(tfrecord_path, output_base_dir, camera_name='FRONT', max_frames=None):
+    """
+    Write the camera's JPEG bytes, one record per frame, into <output_dir>/<camera>.tfrecord.
+    The JPEGs are copied as stored in the segment, nothing is decoded or re-encoded.
+    """
+    os.makedirs(output_base_dir, exist_ok=True)
+    target_camera = getattr(open_dataset.CameraName, camera_name)
+    pack_path = os.path.join(output_base_dir, f"{camera_name.lower()}.tfrecord")
+
+    dataset = tf.data.TFRecordDataset(tfrecord_path, compression_type='')
+    frame_count = 0
+    with tf.io.TFRecordWriter(pack_path) as writer:
+        for data in tqdm(dataset):
+            if max_frames and frame_count >= max_frames:
+                break
+            frame = open_dataset.Frame()
+            frame.ParseFromString(bytearray(data.numpy()))
+            for image in frame.images:
+                if image.name == target_camera:
+                    writer.write(image.image)
+                    break
+            frame_count += 1
+
+    print(f"Packed {frame_count} {camera_name} frames into {pack_path}")
+    return frame_count
+
 def batch_extract_all_cameras(tfrecord_path, output_base_dir, max_frames=None):
     """
     Extract images from all cameras in a tfrecord file
@@ -178,6 +234,8 @@ def main():
                        help='Maximum number of frames to process')
     parser.add_argument('--preview', action='store_true',
                        help='Show preview of images before extraction')
+    parser.add_argument('--pack', action='store_true',
+                       help='Write the JPEGs into one <camera>.tfrecord container instead of separate files')
     
     args = parser.parse_args()
     
@@ -190,7 +248,11 @@ def main():
         display_sample_images(args.tfrecord, max_display=1)
         return
     
-    if args.camera == 'ALL':
+    if args.pack:
+        cameras = ['FRONT', 'FRONT_LEFT', 'FRONT_RIGHT', 'SIDE_LEFT', 'SIDE_RIGHT'] if args.camera == 'ALL' else [args.camera]
+        for camera in cameras:
+            pack_images_to_tfrecord(args.tfrecord, args.output_dir, camera, args.max_frames)
+    elif args.camera == 'ALL':
         batch_extract_all_cameras(args.tfrecord, args.output_dir, args.max_frames)
     else:
         extract_images_from_single_tfrecord(args.tfrecord, args.output_dir, args.camera, args.max_frames)